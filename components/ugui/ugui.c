@@ -48,6 +48,7 @@
 //  Oct 11, 2014  V0.1  First release.
 /* -------------------------------------------------------------------------------- */
 #include "ugui.h"
+#include <string.h>
 
 /* Static functions */
  UG_RESULT _UG_WindowDrawTitle( UG_WINDOW* wnd );
@@ -57,11 +58,65 @@
  void _UG_ButtonUpdate(UG_WINDOW* wnd, UG_OBJECT* obj);
  void _UG_CheckboxUpdate(UG_WINDOW* wnd, UG_OBJECT* obj);
  void _UG_ImageUpdate(UG_WINDOW* wnd, UG_OBJECT* obj);
- void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font);
-
- /* Pointer to the gui */
+ void _UG_PutChar( UG_GUI* g, char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font);
+ void _UG_FramebufferFill( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c );
+ void _UG_Invalidate( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2 );
+ UG_U8 _UG_ClipArea( UG_GUI* g, UG_S16* x1, UG_S16* y1, UG_S16* x2, UG_S16* y2 );
+ void _UG_Pset( UG_GUI* g, UG_S16 x, UG_S16 y, UG_COLOR c );
+ void _UG_Span( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c );
+ void _UG_FillRoundSpans( UG_GUI* g, UG_S16 xl, UG_S16 yt, UG_S16 xr, UG_S16 yb, UG_S16 r, UG_COLOR c );
+ UG_U8 _UG_MapChar( char chr );
+ UG_U8 _UG_PutStringScanline( UG_GUI* g, UG_S16 x, UG_S16 y, const char* str );
+ void _UG_ExpandGlyph( UG_GUI* g, UG_COLOR* dst, UG_S16 stride, UG_U8 bt, UG_S16 width, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font );
+ const unsigned char* _UG_GlyphBits( UG_GUI* g, UG_U8 bt, const UG_FONT* font );
+ #ifdef USE_RLE_FONTS
+ void _UG_DecodeRLE( unsigned char* dst, const unsigned char* src, UG_S16 width, UG_S16 height, UG_U16 bn );
+ #endif
+ #ifdef USE_COLOR_RGB565
+ UG_COLOR _UG_Blend565( UG_COLOR fc, UG_COLOR bc, UG_U8 a );
+ const UG_COLOR* _UG_AlphaTable( UG_GUI* g, UG_COLOR fc, UG_COLOR bc );
+ #endif
+ #ifdef USE_GLYPH_CACHE
+ const UG_COLOR* _UG_GlyphCacheGet( UG_GUI* g, UG_U8 bt, UG_S16 width, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font );
+ void _UG_GlyphCacheUnlink( UG_GUI* g, UG_S16 n );
+ void _UG_GlyphCacheTouch( UG_GUI* g, UG_S16 n );
+ UG_U16 _UG_GlyphCacheBucket( const unsigned char* font, UG_U8 chr, UG_COLOR fc, UG_COLOR bc );
+ #endif
+
+ /* The selected gui, the classic functions draw on it */
 static UG_GUI* gui;
 
+#define SCANLINE_MAX_CHARS 80
+
+/* RGB565 bitmap pixel to UG_COLOR */
+#ifdef USE_COLOR_RGB565
+#define _UG_BMP_COLOR(c) UG_RGB565(c)
+#else
+#define _UG_BMP_COLOR(c) ((((UG_COLOR)(c) & 0xF800) << 8) | (((UG_COLOR)(c) & 0x07E0) << 5) | (((UG_COLOR)(c) & 0x001F) << 3))
+#endif
+
+/* Is the pixel inside the clip rectangle? */
+#define _UG_IN_CLIP(g,x,y) ((x) >= (g)->clip.xs && (x) <= (g)->clip.xe && (y) >= (g)->clip.ys && (y) <= (g)->clip.ye)
+
+/* Fonts laid out as rows of 1 bit pixels, once decoded */
+#define _UG_FONT_1BPP(f) ((f)->font_type == FONT_TYPE_1BPP || (f)->font_type == FONT_TYPE_1BPP_RLE)
+
+#ifdef USE_COLOR_RGB565
+/* Antialiased pixel: pre-blended color for 8 bit coverage b, see _UG_AlphaTable() */
+#define _UG_AA_COLOR(aa,fc,bc,b) ((aa)[((b) + 4) >> 3])
+#else
+#define _UG_AA_COLOR(aa,fc,bc,b) ((((((fc) & 0x0000FF) * (b) + ((bc) & 0x0000FF) * (256 - (b))) >> 8) & 0x0000FF) |\
+                                  (((((fc) & 0x00FF00) * (b) + ((bc) & 0x00FF00) * (256 - (b))) >> 8) & 0x00FF00) |\
+                                  (((((fc) & 0xFF0000) * (b) + ((bc) & 0xFF0000) * (256 - (b))) >> 8) & 0xFF0000))
+#endif
+
+#ifdef USE_RLE_FONTS
+#define _UG_RLE_FITS(f,bn) ((f)->char_height * (bn) <= RLE_GLYPH_BYTES)
+#else
+#define _UG_RLE_FITS(f,bn) 0
+#endif
+
+#ifndef USE_PACKED_FONTS
 #ifdef USE_FONT_4X6
 __UG_FONT_DATA unsigned char font_4x6[256][6]={
 {0x00,0x00,0x00,0x00,0x00,0x00}, // 0x00
@@ -4551,14 +4606,136 @@ __UG_FONT_DATA unsigned char font_32x53[256][212]={
 #ifdef USE_FONT_32X53
    const UG_FONT FONT_32X53 = {(unsigned char*)font_32x53,FONT_TYPE_1BPP,32,53,0,255,NULL};
 #endif
+#endif /* USE_PACKED_FONTS */
 
 
 
-UG_S16 UG_Init( UG_GUI* g, void (*p)(UG_S16,UG_S16,UG_COLOR), UG_S16 x, UG_S16 y )
+/* -------------------------------------------------------------------------------- */
+/* -- 1BPP GLYPH BLITTERS                                                        -- */
+/* -------------------------------------------------------------------------------- */
+/* One per character width of the enabled fonts. The width is a constant so the    */
+/* bytes per row are known and every bit expands to a plain store.                  */
+#define _UG_EXPAND_BITS(d,b,n)                           \
+   do {                                                  \
+      if ( (n) > 0 ) (d)[0] = ((b) & 0x01) ? fc : bc;    \
+      if ( (n) > 1 ) (d)[1] = ((b) & 0x02) ? fc : bc;    \
+      if ( (n) > 2 ) (d)[2] = ((b) & 0x04) ? fc : bc;    \
+      if ( (n) > 3 ) (d)[3] = ((b) & 0x08) ? fc : bc;    \
+      if ( (n) > 4 ) (d)[4] = ((b) & 0x10) ? fc : bc;    \
+      if ( (n) > 5 ) (d)[5] = ((b) & 0x20) ? fc : bc;    \
+      if ( (n) > 6 ) (d)[6] = ((b) & 0x40) ? fc : bc;    \
+      if ( (n) > 7 ) (d)[7] = ((b) & 0x80) ? fc : bc;    \
+   } while (0)
+
+#define _UG_DEFINE_BLITTER(w)                                                                                   \
+static void _UG_Blit1BPP_##w( UG_COLOR* dst, UG_S16 stride, const unsigned char* p, UG_S16 height, UG_COLOR fc, UG_COLOR bc ) \
+{                                                                                                               \
+   UG_S16 i,j;                                                                                                  \
+   for( j=0;j<height;j++ )                                                                                      \
+   {                                                                                                            \
+      for( i=0;i<(w)/8;i++ ) _UG_EXPAND_BITS(dst + i*8, p[i], 8);                                               \
+      if ( (w) % 8 ) _UG_EXPAND_BITS(dst + ((w)/8)*8, p[(w)/8], (w) % 8);                                       \
+      p += ((w) + 7) / 8;                                                                                       \
+      dst += stride;                                                                                            \
+   }                                                                                                            \
+}
+
+#if defined(USE_FONT_4X6)
+#define _UG_BLITTER_4
+_UG_DEFINE_BLITTER(4)
+#endif
+#if defined(USE_FONT_5X8) || defined(USE_FONT_5X12)
+#define _UG_BLITTER_5
+_UG_DEFINE_BLITTER(5)
+#endif
+#if defined(USE_FONT_6X8) || defined(USE_FONT_6X10)
+#define _UG_BLITTER_6
+_UG_DEFINE_BLITTER(6)
+#endif
+#if defined(USE_FONT_7X12)
+#define _UG_BLITTER_7
+_UG_DEFINE_BLITTER(7)
+#endif
+#if defined(USE_FONT_8X8) || defined(USE_FONT_8X12) || defined(USE_FONT_8X12_CYRILLIC) || defined(USE_FONT_8X14)
+#define _UG_BLITTER_8
+_UG_DEFINE_BLITTER(8)
+#endif
+#if defined(USE_FONT_10X16)
+#define _UG_BLITTER_10
+_UG_DEFINE_BLITTER(10)
+#endif
+#if defined(USE_FONT_12X16) || defined(USE_FONT_12X20)
+#define _UG_BLITTER_12
+_UG_DEFINE_BLITTER(12)
+#endif
+#if defined(USE_FONT_16X26)
+#define _UG_BLITTER_16
+_UG_DEFINE_BLITTER(16)
+#endif
+#if defined(USE_FONT_22X36)
+#define _UG_BLITTER_22
+_UG_DEFINE_BLITTER(22)
+#endif
+#if defined(USE_FONT_24X40)
+#define _UG_BLITTER_24
+_UG_DEFINE_BLITTER(24)
+#endif
+#if defined(USE_FONT_32X53)
+#define _UG_BLITTER_32
+_UG_DEFINE_BLITTER(32)
+#endif
+
+static const struct
+{
+   UG_S16 width;
+   UG_GLYPH_BLIT blit;
+} glyph_blitters[] =
+{
+#ifdef _UG_BLITTER_4
+   {4, _UG_Blit1BPP_4},
+#endif
+#ifdef _UG_BLITTER_5
+   {5, _UG_Blit1BPP_5},
+#endif
+#ifdef _UG_BLITTER_6
+   {6, _UG_Blit1BPP_6},
+#endif
+#ifdef _UG_BLITTER_7
+   {7, _UG_Blit1BPP_7},
+#endif
+#ifdef _UG_BLITTER_8
+   {8, _UG_Blit1BPP_8},
+#endif
+#ifdef _UG_BLITTER_10
+   {10, _UG_Blit1BPP_10},
+#endif
+#ifdef _UG_BLITTER_12
+   {12, _UG_Blit1BPP_12},
+#endif
+#ifdef _UG_BLITTER_16
+   {16, _UG_Blit1BPP_16},
+#endif
+#ifdef _UG_BLITTER_22
+   {22, _UG_Blit1BPP_22},
+#endif
+#ifdef _UG_BLITTER_24
+   {24, _UG_Blit1BPP_24},
+#endif
+#ifdef _UG_BLITTER_32
+   {32, _UG_Blit1BPP_32},
+#endif
+   {0, NULL}
+};
+
+/* Sets up g without selecting it. Contexts share no state, so tasks can each */
+/* render into their own one with the Ctx functions.                          */
+UG_S16 UG_InitCtx( UG_GUI* g, void (*p)(UG_S16,UG_S16,UG_COLOR), UG_S16 x, UG_S16 y )
 {
    UG_U8 i;
 
    g->pset = (void(*)(UG_S16,UG_S16,UG_COLOR))p;
+   g->fb = NULL;
+   g->fb_stride = 0;
    g->x_dim = x;
    g->y_dim = y;
    g->console.x_start = 4;
@@ -4575,17 +4752,37 @@ UG_S16 UG_Init( UG_GUI* g, void (*p)(UG_S16,UG_S16,UG_COLOR), UG_S16 x, UG_S16 y
    g->font.start_char = 0;
    g->font.end_char = 0;
    g->font.widths = NULL;
+   g->font_blit = NULL;
    #ifdef USE_COLOR_RGB888
    g->desktop_color = 0x5E8BEf;
    #endif
    #ifdef USE_COLOR_RGB565
-   g->desktop_color = 0x5C5D;
+   g->desktop_color = UG_RGB565(0x5C5D);
    #endif
    g->fore_color = C_WHITE;
    g->back_color = C_BLACK;
    g->next_window = NULL;
    g->active_window = NULL;
    g->last_window = NULL;
+   g->clip.xs = 0;
+   g->clip.ys = 0;
+   g->clip.xe = x - 1;
+   g->clip.ye = y - 1;
+   g->clip_depth = 0;
+   #ifdef USE_COLOR_RGB565
+   g->alpha_table.valid = 0;
+   #endif
+   #ifdef USE_GLYPH_CACHE
+   g->glyph_cache.entries = NULL;
+   g->glyph_cache.count = 0;
+   g->glyph_cache.stats.hits = 0;
+   g->glyph_cache.stats.misses = 0;
+   g->glyph_cache.stats.entries = 0;
+   #endif
+   #ifdef USE_RLE_FONTS
+   for(i=0;i<RLE_CACHE_SLOTS;i++) g->rle_cache.font[i] = NULL;
+   g->rle_cache.next = 0;
+   #endif
 
    /* Clear drivers */
    for(i=0;i<NUMBER_OF_DRIVERS;i++)
@@ -4594,6 +4791,30 @@ UG_S16 UG_Init( UG_GUI* g, void (*p)(UG_S16,UG_S16,UG_COLOR), UG_S16 x, UG_S16 y
       g->driver[i].state = 0;
    }
 
+   return 1;
+}
+
+UG_S16 UG_Init( UG_GUI* g, void (*p)(UG_S16,UG_S16,UG_COLOR), UG_S16 x, UG_S16 y )
+{
+   UG_InitCtx(g, p, x, y);
+   gui = g;
+   return 1;
+}
+
+/* Draw straight into a framebuffer instead of calling pset for every pixel. */
+/* Register DRIVER_INVALIDATE to be told which areas were written. There is  */
+/* no pset: every pixel goes through _UG_Pset, which knows its context.      */
+UG_S16 UG_InitFramebufferCtx( UG_GUI* g, UG_COLOR* buffer, UG_S16 width, UG_S16 height, UG_S16 stride )
+{
+   UG_InitCtx(g, NULL, width, height);
+   g->fb = buffer;
+   g->fb_stride = stride;
+   return 1;
+}
+
+UG_S16 UG_InitFramebuffer( UG_GUI* g, UG_COLOR* buffer, UG_S16 width, UG_S16 height, UG_S16 stride )
+{
+   UG_InitFramebufferCtx(g, buffer, width, height, stride);
    gui = g;
    return 1;
 }
@@ -4608,17 +4829,146 @@ UG_GUI* UG_GetGUI( ) {
     return gui;
 }
 
+void UG_FontSelectCtx( UG_GUI* g, const UG_FONT* font )
+{
+   UG_U8 i;
+
+   g->font = *font;
+   g->font_blit = NULL;
+
+   /* Bind the blitter made for this width, proportional fonts keep the generic path */
+   if ( !_UG_FONT_1BPP(font) || font->widths != NULL ) return;
+
+   for( i=0;glyph_blitters[i].blit != NULL;i++ )
+   {
+      if ( glyph_blitters[i].width == font->char_width )
+      {
+         g->font_blit = glyph_blitters[i].blit;
+         break;
+      }
+   }
+}
+
 void UG_FontSelect( const UG_FONT* font )
 {
-   gui->font = *font;
+   UG_FontSelectCtx(gui, font);
+}
+
+/* Restrict drawing to the part of x1,y1-x2,y2 inside the current clip rectangle */
+UG_RESULT UG_PushClipCtx( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2 )
+{
+   UG_S16 n;
+
+   if ( g->clip_depth == CLIP_STACK_DEPTH ) return UG_RESULT_FAIL;
+
+   if ( x2 < x1 )
+   {
+      n = x2;
+      x2 = x1;
+      x1 = n;
+   }
+   if ( y2 < y1 )
+   {
+      n = y2;
+      y2 = y1;
+      y1 = n;
+   }
+
+   g->clip_stack[g->clip_depth++] = g->clip;
+
+   /* An empty intersection rejects everything */
+   if ( x1 > g->clip.xs ) g->clip.xs = x1;
+   if ( y1 > g->clip.ys ) g->clip.ys = y1;
+   if ( x2 < g->clip.xe ) g->clip.xe = x2;
+   if ( y2 < g->clip.ye ) g->clip.ye = y2;
+
+   return UG_RESULT_OK;
+}
+
+UG_RESULT UG_PushClip( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2 )
+{
+   return UG_PushClipCtx(gui, x1, y1, x2, y2);
+}
+
+UG_RESULT UG_PopClipCtx( UG_GUI* g )
+{
+   if ( g->clip_depth == 0 ) return UG_RESULT_FAIL;
+
+   g->clip = g->clip_stack[--g->clip_depth];
+
+   return UG_RESULT_OK;
+}
+
+UG_RESULT UG_PopClip( void )
+{
+   return UG_PopClipCtx(gui);
+}
+
+#ifdef USE_GLYPH_CACHE
+/* Hand a buffer to the glyph cache, it holds as many max_width x max_height glyphs as fit */
+void UG_GlyphCacheInitCtx( UG_GUI* g, void* buffer, UG_U32 size, UG_U16 max_width, UG_U16 max_height )
+{
+   UG_U32 slot = sizeof(UG_GLYPH_CACHE_ENTRY) + max_width * max_height * sizeof(UG_COLOR);
+   UG_U32 count = (buffer && slot) ? size / slot : 0;
+   UG_U16 i;
+
+   if ( count > 0x7FFF ) count = 0x7FFF;
+
+   g->glyph_cache.count = count;
+   g->glyph_cache.max_width = max_width;
+   g->glyph_cache.max_height = max_height;
+   g->glyph_cache.entries = (UG_GLYPH_CACHE_ENTRY*)buffer;
+   g->glyph_cache.pixels = (UG_COLOR*)(g->glyph_cache.entries + count);
+   g->glyph_cache.oldest = -1;
+   g->glyph_cache.newest = -1;
+   g->glyph_cache.stats.hits = 0;
+   g->glyph_cache.stats.misses = 0;
+   g->glyph_cache.stats.entries = count;
+
+   for( i=0;i<GLYPH_CACHE_BUCKETS;i++ )
+   {
+      g->glyph_cache.buckets[i] = -1;
+   }
+
+   for( i=0;i<count;i++ )
+   {
+      g->glyph_cache.entries[i].font = NULL;
+      _UG_GlyphCacheTouch(g, i);
+   }
+}
+
+void UG_GlyphCacheInit( void* buffer, UG_U32 size, UG_U16 max_width, UG_U16 max_height )
+{
+   UG_GlyphCacheInitCtx(gui, buffer, size, max_width, max_height);
+}
+
+void UG_GlyphCacheGetStatsCtx( UG_GUI* g, UG_GLYPH_CACHE_STATS* stats, UG_U8 reset )
+{
+   *stats = g->glyph_cache.stats;
+   if ( reset )
+   {
+      g->glyph_cache.stats.hits = 0;
+      g->glyph_cache.stats.misses = 0;
+   }
+}
+
+void UG_GlyphCacheGetStats( UG_GLYPH_CACHE_STATS* stats, UG_U8 reset )
+{
+   UG_GlyphCacheGetStatsCtx(gui, stats, reset);
+}
+#endif
+
+void UG_FillScreenCtx( UG_GUI* g, UG_COLOR c )
+{
+   UG_FillFrameCtx(g, 0,0,g->x_dim-1,g->y_dim-1,c);
 }
 
 void UG_FillScreen( UG_COLOR c )
 {
-   UG_FillFrame(0,0,gui->x_dim-1,gui->y_dim-1,c);
+   UG_FillScreenCtx(gui, c);
 }
 
-void UG_FillFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+void UG_FillFrameCtx( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
 {
    UG_S16 n,m;
 
@@ -4635,72 +4985,66 @@ void UG_FillFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
       y1 = n;
    }
 
+   if ( !_UG_ClipArea(g, &x1, &y1, &x2, &y2) ) return;
+
    /* Is hardware acceleration available? */
-   if ( gui->driver[DRIVER_FILL_FRAME].state & DRIVER_ENABLED )
+   if ( g->driver[DRIVER_FILL_FRAME].state & DRIVER_ENABLED )
+   {
+      if( ((UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))g->driver[DRIVER_FILL_FRAME].driver)(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
+   }
+
+   if ( g->fb != NULL )
    {
-      if( ((UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))gui->driver[DRIVER_FILL_FRAME].driver)(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
+      _UG_FramebufferFill(g, x1,y1,x2,y2,c);
+      return;
    }
 
    for( m=y1; m<=y2; m++ )
    {
       for( n=x1; n<=x2; n++ )
       {
-         gui->pset(n,m,c);
+         _UG_Pset(g, n,m,c);
       }
    }
 }
 
-void UG_FillRoundFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_S16 r, UG_COLOR c )
+void UG_FillFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+{
+   UG_FillFrameCtx(gui, x1, y1, x2, y2, c);
+}
+
+void UG_FillRoundFrameCtx( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_S16 r, UG_COLOR c )
 {
-   UG_S16  x,y,xd;
+   UG_S16 n;
 
    if ( x2 < x1 )
    {
-      x = x2;
+      n = x2;
       x2 = x1;
-      x1 = x;
+      x1 = n;
    }
    if ( y2 < y1 )
    {
-      y = y2;
+      n = y2;
       y2 = y1;
-      y1 = y;
+      y1 = n;
    }
 
    if ( r<=0 ) return;
 
-   xd = 3 - (r << 1);
-   x = 0;
-   y = r;
+   /* Corners can't overlap */
+   if ( r > (x2 - x1) >> 1 ) r = (x2 - x1) >> 1;
+   if ( r > (y2 - y1) >> 1 ) r = (y2 - y1) >> 1;
 
-   UG_FillFrame(x1 + r, y1, x2 - r, y2, c);
+   _UG_FillRoundSpans(g, x1 + r, y1 + r, x2 - r, y2 - r, r, c);
+}
 
-   while ( x <= y )
-   {
-     if( y > 0 )
-     {
-        UG_DrawLine(x2 + x - r, y1 - y + r, x2+ x - r, y + y2 - r, c);
-        UG_DrawLine(x1 - x + r, y1 - y + r, x1- x + r, y + y2 - r, c);
-     }
-     if( x > 0 )
-     {
-        UG_DrawLine(x1 - y + r, y1 - x + r, x1 - y + r, x + y2 - r, c);
-        UG_DrawLine(x2 + y - r, y1 - x + r, x2 + y - r, x + y2 - r, c);
-     }
-     if ( xd < 0 )
-     {
-        xd += (x << 2) + 6;
-     }
-     else
-     {
-        xd += ((x - y) << 2) + 10;
-        y--;
-     }
-     x++;
-   }
+void UG_FillRoundFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_S16 r, UG_COLOR c )
+{
+   UG_FillRoundFrameCtx(gui, x1, y1, x2, y2, r, c);
 }
 
-void UG_DrawMesh( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+void UG_DrawMeshCtx( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
 {
    UG_S16 n,m;
 
@@ -4721,40 +5065,55 @@ void UG_DrawMesh( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
    {
       for( n=x1; n<=x2; n+=2 )
       {
-         gui->pset(n,m,c);
+         _UG_Pset(g, n,m,c);
       }
    }
 }
 
+void UG_DrawMesh( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+{
+   UG_DrawMeshCtx(gui, x1, y1, x2, y2, c);
+}
+
+void UG_DrawFrameCtx( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+{
+   UG_DrawLineCtx(g, x1,y1,x2,y1,c);
+   UG_DrawLineCtx(g, x1,y2,x2,y2,c);
+   UG_DrawLineCtx(g, x1,y1,x1,y2,c);
+   UG_DrawLineCtx(g, x2,y1,x2,y2,c);
+}
+
 void UG_DrawFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
 {
-   UG_DrawLine(x1,y1,x2,y1,c);
-   UG_DrawLine(x1,y2,x2,y2,c);
-   UG_DrawLine(x1,y1,x1,y2,c);
-   UG_DrawLine(x2,y1,x2,y2,c);
+   UG_DrawFrameCtx(gui, x1, y1, x2, y2, c);
 }
 
-void UG_DrawTriangle( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_U8 h, UG_COLOR c )
+void UG_DrawTriangleCtx( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_U8 h, UG_COLOR c )
 {
    if (h == 0) {
-       UG_DrawLine(x1,y1,x2,y1,c); //horizontal
-       UG_DrawLine(x1,y1,(x2-x1)/2+x1,y2,c);
-       UG_DrawLine(x2,y1,(x2-x1)/2+x1,y2,c);
+       UG_DrawLineCtx(g, x1,y1,x2,y1,c); //horizontal
+       UG_DrawLineCtx(g, x1,y1,(x2-x1)/2+x1,y2,c);
+       UG_DrawLineCtx(g, x2,y1,(x2-x1)/2+x1,y2,c);
    } else {
-       UG_DrawLine(x1,y1,x1,y2,c); //vertical
-       UG_DrawLine(x1,y1,x2,(y2-y1)/2+y1,c);
-       UG_DrawLine(x1,y2,x2,(y2-y1)/2+y1,c);
+       UG_DrawLineCtx(g, x1,y1,x1,y2,c); //vertical
+       UG_DrawLineCtx(g, x1,y1,x2,(y2-y1)/2+y1,c);
+       UG_DrawLineCtx(g, x1,y2,x2,(y2-y1)/2+y1,c);
    }
 }
 
-void UG_FillTriangle(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_U8 h, UG_COLOR c )
+void UG_DrawTriangle( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_U8 h, UG_COLOR c )
+{
+   UG_DrawTriangleCtx(gui, x1, y1, x2, y2, h, c);
+}
+
+void UG_FillTriangleCtx( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_U8 h, UG_COLOR c )
 {
    UG_S16 n;
 
    /* Is hardware acceleration available? */
-   /*if ( gui->driver[DRIVER_FILL_FRAME].state & DRIVER_ENABLED )
+   /*if ( g->driver[DRIVER_FILL_FRAME].state & DRIVER_ENABLED )
    {
-      if( ((UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))gui->driver[DRIVER_FILL_FRAME].driver)(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
+      if( ((UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))g->driver[DRIVER_FILL_FRAME].driver)(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
    }*/
     if (h == 0) {
 
@@ -4773,8 +5132,8 @@ void UG_FillTriangle(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_U8 h, UG_COL
 
       for( n=x1; n<=x2; n++ )
       {
-          UG_DrawLine(n,y1,(x2-x1)/2+x1,y2,c);
-         //gui->pset(n,m,c);
+          UG_DrawLineCtx(g, n,y1,(x2-x1)/2+x1,y2,c);
+         //_UG_Pset(g, n,m,c);
       }
     } else {
 
@@ -4793,8 +5152,8 @@ void UG_FillTriangle(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_U8 h, UG_COL
 
         for( n=y1; n<=y2; n++ )
         {
-            UG_DrawLine(x1,n,x2,(y2-y1)/2+y1,c);
-           //gui->pset(n,m,c);
+            UG_DrawLineCtx(g, x1,n,x2,(y2-y1)/2+y1,c);
+           //_UG_Pset(g, n,m,c);
         }
 
 
@@ -4805,7 +5164,12 @@ void UG_FillTriangle(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_U8 h, UG_COL
    //}
 }
 
-void UG_DrawRoundFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_S16 r, UG_COLOR c )
+void UG_FillTriangle( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_U8 h, UG_COLOR c )
+{
+   UG_FillTriangleCtx(gui, x1, y1, x2, y2, h, c);
+}
+
+void UG_DrawRoundFrameCtx( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_S16 r, UG_COLOR c )
 {
    UG_S16 n;
    if ( x2 < x1 )
@@ -4824,99 +5188,59 @@ void UG_DrawRoundFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_S16 r, UG
    if ( r > x2 ) return;
    if ( r > y2 ) return;
 
-   UG_DrawLine(x1+r, y1, x2-r, y1, c);
-   UG_DrawLine(x1+r, y2, x2-r, y2, c);
-   UG_DrawLine(x1, y1+r, x1, y2-r, c);
-   UG_DrawLine(x2, y1+r, x2, y2-r, c);
-   UG_DrawArc(x1+r, y1+r, r, 0x0C, c);
-   UG_DrawArc(x2-r, y1+r, r, 0x03, c);
-   UG_DrawArc(x1+r, y2-r, r, 0x30, c);
-   UG_DrawArc(x2-r, y2-r, r, 0xC0, c);
+   UG_DrawLineCtx(g, x1+r, y1, x2-r, y1, c);
+   UG_DrawLineCtx(g, x1+r, y2, x2-r, y2, c);
+   UG_DrawLineCtx(g, x1, y1+r, x1, y2-r, c);
+   UG_DrawLineCtx(g, x2, y1+r, x2, y2-r, c);
+   UG_DrawArcCtx(g, x1+r, y1+r, r, 0x0C, c);
+   UG_DrawArcCtx(g, x2-r, y1+r, r, 0x03, c);
+   UG_DrawArcCtx(g, x1+r, y2-r, r, 0x30, c);
+   UG_DrawArcCtx(g, x2-r, y2-r, r, 0xC0, c);
 }
 
-void UG_DrawPixel( UG_S16 x0, UG_S16 y0, UG_COLOR c )
+void UG_DrawRoundFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_S16 r, UG_COLOR c )
 {
-   gui->pset(x0,y0,c);
+   UG_DrawRoundFrameCtx(gui, x1, y1, x2, y2, r, c);
 }
 
-void UG_DrawCircle( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_COLOR c )
+void UG_DrawPixelCtx( UG_GUI* g, UG_S16 x0, UG_S16 y0, UG_COLOR c )
 {
-   UG_S16 x,y,xd,yd,e;
-
-   if ( x0<0 ) return;
-   if ( y0<0 ) return;
-   if ( r<=0 ) return;
-
-   xd = 1 - (r << 1);
-   yd = 0;
-   e = 0;
-   x = r;
-   y = 0;
+   if ( _UG_IN_CLIP(g,x0,y0) ) _UG_Pset(g, x0,y0,c);
+}
 
-   while ( x >= y )
-   {
-      gui->pset(x0 - x, y0 + y, c);
-      gui->pset(x0 - x, y0 - y, c);
-      gui->pset(x0 + x, y0 + y, c);
-      gui->pset(x0 + x, y0 - y, c);
-      gui->pset(x0 - y, y0 + x, c);
-      gui->pset(x0 - y, y0 - x, c);
-      gui->pset(x0 + y, y0 + x, c);
-      gui->pset(x0 + y, y0 - x, c);
+void UG_DrawPixel( UG_S16 x0, UG_S16 y0, UG_COLOR c )
+{
+   UG_DrawPixelCtx(gui, x0, y0, c);
+}
 
-      y++;
-      e += yd;
-      yd += 2;
-      if ( ((e << 1) + xd) > 0 )
-      {
-         x--;
-         e += xd;
-         xd += 2;
-      }
-   }
+void UG_DrawCircleCtx( UG_GUI* g, UG_S16 x0, UG_S16 y0, UG_S16 r, UG_COLOR c )
+{
+   UG_DrawArcCtx(g, x0, y0, r, 0xFF, c);
 }
 
-void UG_FillCircle( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_COLOR c )
+void UG_DrawCircle( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_COLOR c )
 {
-   UG_S16  x,y,xd;
+   UG_DrawCircleCtx(gui, x0, y0, r, c);
+}
 
+void UG_FillCircleCtx( UG_GUI* g, UG_S16 x0, UG_S16 y0, UG_S16 r, UG_COLOR c )
+{
    if ( x0<0 ) return;
    if ( y0<0 ) return;
    if ( r<=0 ) return;
 
-   xd = 3 - (r << 1);
-   x = 0;
-   y = r;
+   _UG_FillRoundSpans(g, x0, y0, x0, y0, r, c);
+   UG_DrawCircleCtx(g, x0, y0, r,c);
+}
 
-   while ( x <= y )
-   {
-     if( y > 0 )
-     {
-        UG_DrawLine(x0 - x, y0 - y,x0 - x, y0 + y, c);
-        UG_DrawLine(x0 + x, y0 - y,x0 + x, y0 + y, c);
-     }
-     if( x > 0 )
-     {
-        UG_DrawLine(x0 - y, y0 - x,x0 - y, y0 + x, c);
-        UG_DrawLine(x0 + y, y0 - x,x0 + y, y0 + x, c);
-     }
-     if ( xd < 0 )
-     {
-        xd += (x << 2) + 6;
-     }
-     else
-     {
-        xd += ((x - y) << 2) + 10;
-        y--;
-     }
-     x++;
-   }
-   UG_DrawCircle(x0, y0, r,c);
+void UG_FillCircle( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_COLOR c )
+{
+   UG_FillCircleCtx(gui, x0, y0, r, c);
 }
 
-void UG_DrawArc( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_U8 s, UG_COLOR c )
+void UG_DrawArcCtx( UG_GUI* g, UG_S16 x0, UG_S16 y0, UG_S16 r, UG_U8 s, UG_COLOR c )
 {
-   UG_S16 x,y,xd,yd,e;
+   UG_S16 x,y,xd,yd,e,ys,ye;
 
    if ( x0<0 ) return;
    if ( y0<0 ) return;
@@ -4927,28 +5251,37 @@ void UG_DrawArc( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_U8 s, UG_COLOR c )
    e = 0;
    x = r;
    y = 0;
+   ys = 0;
 
    while ( x >= y )
    {
-      // Q1
-      if ( s & 0x01 ) gui->pset(x0 + x, y0 - y, c);
-      if ( s & 0x02 ) gui->pset(x0 + y, y0 - x, c);
+      ye = y;
+      y++;
+      e += yd;
+      yd += 2;
+
+      /* Points ys..ye share x, draw them as spans before x moves on */
+      if ( ((e << 1) + xd) > 0 || x < y )
+      {
+         // Q1
+         if ( s & 0x01 ) _UG_Span(g, x0 + x, y0 - ye, x0 + x, y0 - ys, c);
+         if ( s & 0x02 ) _UG_Span(g, x0 + ys, y0 - x, x0 + ye, y0 - x, c);
 
-      // Q2
-      if ( s & 0x04 ) gui->pset(x0 - y, y0 - x, c);
-      if ( s & 0x08 ) gui->pset(x0 - x, y0 - y, c);
+         // Q2
+         if ( s & 0x04 ) _UG_Span(g, x0 - ye, y0 - x, x0 - ys, y0 - x, c);
+         if ( s & 0x08 ) _UG_Span(g, x0 - x, y0 - ye, x0 - x, y0 - ys, c);
 
-      // Q3
-      if ( s & 0x10 ) gui->pset(x0 - x, y0 + y, c);
-      if ( s & 0x20 ) gui->pset(x0 - y, y0 + x, c);
+         // Q3
+         if ( s & 0x10 ) _UG_Span(g, x0 - x, y0 + ys, x0 - x, y0 + ye, c);
+         if ( s & 0x20 ) _UG_Span(g, x0 - ye, y0 + x, x0 - ys, y0 + x, c);
 
-      // Q4
-      if ( s & 0x40 ) gui->pset(x0 + y, y0 + x, c);
-      if ( s & 0x80 ) gui->pset(x0 + x, y0 + y, c);
+         // Q4
+         if ( s & 0x40 ) _UG_Span(g, x0 + ys, y0 + x, x0 + ye, y0 + x, c);
+         if ( s & 0x80 ) _UG_Span(g, x0 + x, y0 + ys, x0 + x, y0 + ye, c);
+
+         ys = y;
+      }
 
-      y++;
-      e += yd;
-      yd += 2;
       if ( ((e << 1) + xd) > 0 )
       {
          x--;
@@ -4958,14 +5291,30 @@ void UG_DrawArc( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_U8 s, UG_COLOR c )
    }
 }
 
-void UG_DrawLine( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+void UG_DrawArc( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_U8 s, UG_COLOR c )
 {
-   UG_S16 n, dx, dy, sgndx, sgndy, dxabs, dyabs, x, y, drawx, drawy;
+   UG_DrawArcCtx(gui, x0, y0, r, s, c);
+}
 
-   /* Is hardware acceleration available? */
-   if ( gui->driver[DRIVER_DRAW_LINE].state & DRIVER_ENABLED )
+void UG_DrawLineCtx( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+{
+   UG_S16 n, dx, dy, sgndx, sgndy, dxabs, dyabs, x, y, drawx, drawy, start;
+
+   /* Entirely outside the clip rectangle? */
+   if ( (x1 < g->clip.xs && x2 < g->clip.xs) || (x1 > g->clip.xe && x2 > g->clip.xe) ) return;
+   if ( (y1 < g->clip.ys && y2 < g->clip.ys) || (y1 > g->clip.ye && y2 > g->clip.ye) ) return;
+
+   /* Is hardware acceleration available? Clipped lines are drawn below */
+   if ( (g->driver[DRIVER_DRAW_LINE].state & DRIVER_ENABLED) && _UG_IN_CLIP(g,x1,y1) && _UG_IN_CLIP(g,x2,y2) )
+   {
+      if( ((UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))g->driver[DRIVER_DRAW_LINE].driver)(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
+   }
+
+   /* Horizontal and vertical lines are a single span */
+   if ( x1 == x2 || y1 == y2 )
    {
-      if( ((UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))gui->driver[DRIVER_DRAW_LINE].driver)(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
+      _UG_Span(g, x1<x2?x1:x2, y1<y2?y1:y2, x1<x2?x2:x1, y1<y2?y2:y1, c);
+      return;
    }
 
    dx = x2 - x1;
@@ -4979,73 +5328,95 @@ void UG_DrawLine( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
    drawx = x1;
    drawy = y1;
 
-   gui->pset(drawx, drawy,c);
-
+   /* Bresenham, emitting a span each time the minor axis steps */
    if( dxabs >= dyabs )
    {
+      start = drawx;
       for( n=0; n<dxabs; n++ )
       {
          y += dyabs;
          if( y >= dxabs )
          {
             y -= dxabs;
+            _UG_Span(g, start<drawx?start:drawx, drawy, start<drawx?drawx:start, drawy, c);
             drawy += sgndy;
+            start = drawx + sgndx;
          }
          drawx += sgndx;
-         gui->pset(drawx, drawy,c);
       }
+      _UG_Span(g, start<drawx?start:drawx, drawy, start<drawx?drawx:start, drawy, c);
    }
    else
    {
+      start = drawy;
       for( n=0; n<dyabs; n++ )
       {
          x += dxabs;
          if( x >= dyabs )
          {
             x -= dyabs;
+            _UG_Span(g, drawx, start<drawy?start:drawy, drawx, start<drawy?drawy:start, c);
             drawx += sgndx;
+            start = drawy + sgndy;
          }
          drawy += sgndy;
-         gui->pset(drawx, drawy,c);
       }
-   }  
+      _UG_Span(g, drawx, start<drawy?start:drawy, drawx, start<drawy?drawy:start, c);
+   }
 }
 
-void UG_PutString( UG_S16 x, UG_S16 y, const char* str )
+void UG_DrawLine( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+{
+   UG_DrawLineCtx(gui, x1, y1, x2, y2, c);
+}
+
+void UG_PutStringCtx( UG_GUI* g, UG_S16 x, UG_S16 y, const char* str )
 {
    UG_S16 xp,yp;
    UG_U8 cw;
    char chr;
 
+   if ( _UG_PutStringScanline(g, x, y, str) ) return;
+
    xp=x;
    yp=y;
 
    while ( *str != 0 )
    {
       chr = *str++;
-	  if (chr < gui->font.start_char || chr > gui->font.end_char) continue;
+	  if (chr < g->font.start_char || chr > g->font.end_char) continue;
       if ( chr == '\n' )
       {
-         xp = gui->x_dim;
+         xp = g->x_dim;
          continue;
       }
-	  cw = gui->font.widths ? gui->font.widths[chr - gui->font.start_char] : gui->font.char_width;
+	  cw = g->font.widths ? g->font.widths[chr - g->font.start_char] : g->font.char_width;
 
-      if ( xp + cw > gui->x_dim - 1 )
+      if ( xp + cw > g->x_dim - 1 )
       {
          xp = x;
-         yp += gui->font.char_height+gui->char_v_space;
+         yp += g->font.char_height+g->char_v_space;
       }
 
-      UG_PutChar(chr, xp, yp, gui->fore_color, gui->back_color);
+      UG_PutCharCtx(g, chr, xp, yp, g->fore_color, g->back_color);
 
-      xp += cw + gui->char_h_space;
+      xp += cw + g->char_h_space;
    }
 }
 
+void UG_PutString( UG_S16 x, UG_S16 y, const char* str )
+{
+   UG_PutStringCtx(gui, x, y, str);
+}
+
+void UG_PutCharCtx( UG_GUI* g, char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc )
+{
+	_UG_PutChar(g, chr,x,y,fc,bc,&g->font);
+}
+
 void UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc )
 {
-	_UG_PutChar(chr,x,y,fc,bc,&gui->font);
+   UG_PutCharCtx(gui, chr, x, y, fc, bc);
 }
 
 void UG_ConsolePutString( char* str )
@@ -5101,14 +5472,24 @@ void UG_ConsoleSetBackcolor( UG_COLOR c )
    gui->console.back_color = c;
 }
 
+void UG_SetForecolorCtx( UG_GUI* g, UG_COLOR c )
+{
+   g->fore_color = c;
+}
+
 void UG_SetForecolor( UG_COLOR c )
 {
-   gui->fore_color = c;
+   UG_SetForecolorCtx(gui, c);
 }
 
-void UG_SetBackcolor( UG_COLOR c )
+void UG_SetBackcolorCtx( UG_GUI* g, UG_COLOR c )
 {
-   gui->back_color = c;
+   g->back_color = c;
+}
+
+void UG_SetBackcolor( UG_COLOR c )
+{
+   UG_SetBackcolorCtx(gui, c);
 }
 
 UG_COLOR UG_GetForecolor( ) {
@@ -5129,14 +5510,24 @@ UG_S16 UG_GetYDim( void )
    return gui->y_dim;
 }
 
+void UG_FontSetHSpaceCtx( UG_GUI* g, UG_U16 s )
+{
+   g->char_h_space = s;
+}
+
 void UG_FontSetHSpace( UG_U16 s )
 {
-   gui->char_h_space = s;
+   UG_FontSetHSpaceCtx(gui, s);
+}
+
+void UG_FontSetVSpaceCtx( UG_GUI* g, UG_U16 s )
+{
+   g->char_v_space = s;
 }
 
 void UG_FontSetVSpace( UG_U16 s )
 {
-   gui->char_v_space = s;
+   UG_FontSetVSpaceCtx(gui, s);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -5242,92 +5633,92 @@ const UG_COLOR pal_checkbox_released[] =
 #ifdef USE_COLOR_RGB565
 const UG_COLOR pal_window[] =
 {
-   0x632C,
-   0x632C,
-   0x632C,
-   0x632C,
+   UG_RGB565(0x632C),
+   UG_RGB565(0x632C),
+   UG_RGB565(0x632C),
+   UG_RGB565(0x632C),
 
-   0xFFFF,
-   0xFFFF,
-   0x6B4D,
-   0x6B4D,
+   UG_RGB565(0xFFFF),
+   UG_RGB565(0xFFFF),
+   UG_RGB565(0x6B4D),
+   UG_RGB565(0x6B4D),
 
-   0xE71C,
-   0xE71C,
-   0x9D13,
-   0x9D13,
+   UG_RGB565(0xE71C),
+   UG_RGB565(0xE71C),
+   UG_RGB565(0x9D13),
+   UG_RGB565(0x9D13),
 };
 
 const UG_COLOR pal_button_pressed[] =
 {
-    0x632C,
-    0x632C,
-    0x632C,
-    0x632C,
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
 
-    0x9D13,
-    0x9D13,
-    0x9D13,
-    0x9D13,
+    UG_RGB565(0x9D13),
+    UG_RGB565(0x9D13),
+    UG_RGB565(0x9D13),
+    UG_RGB565(0x9D13),
 
-    0xEF7D,
-    0xEF7D,
-    0xEF7D,
-    0xEF7D,
+    UG_RGB565(0xEF7D),
+    UG_RGB565(0xEF7D),
+    UG_RGB565(0xEF7D),
+    UG_RGB565(0xEF7D),
 };
 
 const UG_COLOR pal_button_released[] =
 {
-    0x632C,
-    0x632C,
-    0x632C,
-    0x632C,
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
 
-    0xFFFF,
-    0xFFFF,
-    0x6B4D,
-    0x6B4D,
+    UG_RGB565(0xFFFF),
+    UG_RGB565(0xFFFF),
+    UG_RGB565(0x6B4D),
+    UG_RGB565(0x6B4D),
 
-    0xE71C,
-    0xE71C,
-    0x9D13,
-    0x9D13,
+    UG_RGB565(0xE71C),
+    UG_RGB565(0xE71C),
+    UG_RGB565(0x9D13),
+    UG_RGB565(0x9D13),
 };
 
 const UG_COLOR pal_checkbox_pressed[] =
 {
-    0x632C,
-    0x632C,
-    0x632C,
-    0x632C,
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
 
-    0x9D13,
-    0x9D13,
-    0x9D13,
-    0x9D13,
+    UG_RGB565(0x9D13),
+    UG_RGB565(0x9D13),
+    UG_RGB565(0x9D13),
+    UG_RGB565(0x9D13),
 
-    0xEF7D,
-    0xEF7D,
-    0xEF7D,
-    0xEF7D,
+    UG_RGB565(0xEF7D),
+    UG_RGB565(0xEF7D),
+    UG_RGB565(0xEF7D),
+    UG_RGB565(0xEF7D),
 };
 
 const UG_COLOR pal_checkbox_released[] =
 {
-    0x632C,
-    0x632C,
-    0x632C,
-    0x632C,
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
+    UG_RGB565(0x632C),
 
-    0xFFFF,
-    0xFFFF,
-    0x6B4D,
-    0x6B4D,
+    UG_RGB565(0xFFFF),
+    UG_RGB565(0xFFFF),
+    UG_RGB565(0x6B4D),
+    UG_RGB565(0x6B4D),
 
-    0xE71C,
-    0xE71C,
-    0x9D13,
-    0x9D13,
+    UG_RGB565(0xE71C),
+    UG_RGB565(0xE71C),
+    UG_RGB565(0x9D13),
+    UG_RGB565(0x9D13),
 };
 #endif
 
@@ -5336,27 +5727,19 @@ const UG_COLOR pal_checkbox_released[] =
 /* -------------------------------------------------------------------------------- */
 /* -- INTERNAL FUNCTIONS                                                         -- */
 /* -------------------------------------------------------------------------------- */
-void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font)
+void _UG_PutChar( UG_GUI* g, char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font)
 {
    UG_U16 i,j,k,xo,yo,c,bn,actual_char_width;
-   UG_U8 b,bt;
+   UG_U8 b,bt,inside;
    UG_U32 index;
    UG_COLOR color;
+   const unsigned char* p;
    void(*push_pixel)(UG_COLOR);
+   #ifdef USE_COLOR_RGB565
+   const UG_COLOR* aa = NULL;
+   #endif
 
-   bt = (UG_U8)chr;
-
-   switch ( bt )
-   {
-      case 0xF6: bt = 0x94; break; // ö
-      case 0xD6: bt = 0x99; break; // Ö
-      case 0xFC: bt = 0x81; break; // ü
-      case 0xDC: bt = 0x9A; break; // Ü
-      case 0xE4: bt = 0x84; break; // ä
-      case 0xC4: bt = 0x8E; break; // Ä
-      case 0xB5: bt = 0xE6; break; // µ
-      case 0xB0: bt = 0xF8; break; // °
-   }
+   bt = _UG_MapChar(chr);
 
    if (bt < font->start_char || bt > font->end_char) return;
    
@@ -5367,21 +5750,33 @@ void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const
    if ( font->char_width % 8 ) bn++;
    actual_char_width = (font->widths ? font->widths[bt - font->start_char] : font->char_width);
 
+   /* Compressed glyphs too big for the decode cache are skipped */
+   if ( font->font_type == FONT_TYPE_1BPP_RLE && !_UG_RLE_FITS(font, bn) ) return;
+
+   /* Skip glyphs outside the clip rectangle, partly visible ones are drawn pixel by pixel */
+   if ( x > g->clip.xe || y > g->clip.ye ) return;
+   if ( x + actual_char_width - 1 < g->clip.xs || y + font->char_height - 1 < g->clip.ys ) return;
+   inside = x >= g->clip.xs && y >= g->clip.ys && x + actual_char_width - 1 <= g->clip.xe && y + font->char_height - 1 <= g->clip.ye;
+
+   #ifdef USE_COLOR_RGB565
+   if ( font->font_type == FONT_TYPE_8BPP ) aa = _UG_AlphaTable(g, fc, bc);
+   #endif
+
    /* Is hardware acceleration available? */
-   if ( gui->driver[DRIVER_FILL_AREA].state & DRIVER_ENABLED )
+   if ( inside && (g->driver[DRIVER_FILL_AREA].state & DRIVER_ENABLED) )
    {
 	   //(void(*)(UG_COLOR))
-      push_pixel = ((void*(*)(UG_S16, UG_S16, UG_S16, UG_S16))gui->driver[DRIVER_FILL_AREA].driver)(x,y,x+actual_char_width-1,y+font->char_height-1);
+      push_pixel = ((void*(*)(UG_S16, UG_S16, UG_S16, UG_S16))g->driver[DRIVER_FILL_AREA].driver)(x,y,x+actual_char_width-1,y+font->char_height-1);
 	   
-      if (font->font_type == FONT_TYPE_1BPP)
+      if (_UG_FONT_1BPP(font))
 	  {
-	      index = (bt - font->start_char)* font->char_height * bn;
+	      p = _UG_GlyphBits(g, bt, font);
 		  for( j=0;j<font->char_height;j++ )
 		  {
 			 c=actual_char_width;
 			 for( i=0;i<bn;i++ )
 			 {
-				b = font->p[index++];
+				b = *p++;
 				for( k=0;(k<8) && c;k++ )
 				{
 				   if( b & 0x01 )
@@ -5406,37 +5801,82 @@ void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const
 			  for( i=0;i<actual_char_width;i++ )
 			  {
 				 b = font->p[index++];
-				 color = ((((fc & 0x0000FF) * b + (bc & 0x0000FF) * (256 - b)) >> 8) & 0x0000FF) |//Blue component
-				         ((((fc & 0x00FF00) * b + (bc & 0x00FF00) * (256 - b)) >> 8) & 0x00FF00) |//Green component
-				         ((((fc & 0xFF0000) * b + (bc & 0xFF0000) * (256 - b)) >> 8) & 0xFF0000); //Red component
+				 color = _UG_AA_COLOR(aa,fc,bc,b);
 				 push_pixel(color);
 			  }
 			  index += font->char_width - actual_char_width;
 		  }
 	  }
    }
+   else if ( inside && g->fb != NULL )
+   {
+      /* Framebuffer output, the glyph is entirely visible */
+      UG_COLOR* row = g->fb + y * g->fb_stride + x;
+      UG_COLOR* dst;
+
+      if (_UG_FONT_1BPP(font))
+      {
+         #ifdef USE_GLYPH_CACHE
+         const UG_COLOR* glyph = _UG_GlyphCacheGet(g, bt, actual_char_width, fc, bc, font);
+         if ( glyph != NULL )
+         {
+            for( j=0;j<font->char_height;j++ )
+            {
+               memcpy(row, glyph, actual_char_width * sizeof(UG_COLOR));
+               glyph += actual_char_width;
+               row += g->fb_stride;
+            }
+         }
+         else
+         #endif
+         {
+            _UG_ExpandGlyph(g, row, g->fb_stride, bt, actual_char_width, fc, bc, font);
+         }
+      }
+      else if (font->font_type == FONT_TYPE_8BPP)
+      {
+         index = (bt - font->start_char)* font->char_height * font->char_width;
+         for( j=0;j<font->char_height;j++ )
+         {
+            dst = row;
+            for( i=0;i<actual_char_width;i++ )
+            {
+               b = font->p[index++];
+               *dst++ = _UG_AA_COLOR(aa,fc,bc,b);
+            }
+            index += font->char_width - actual_char_width;
+            row += g->fb_stride;
+         }
+      }
+
+      _UG_Invalidate(g, x, y, x + actual_char_width - 1, y + font->char_height - 1);
+   }
    else
    {
 	   /*Not accelerated output*/
-	   if (font->font_type == FONT_TYPE_1BPP)
+	   if (_UG_FONT_1BPP(font))
 	   {
-         index = (bt - font->start_char)* font->char_height * bn;
+         p = _UG_GlyphBits(g, bt, font);
          for( j=0;j<font->char_height;j++ )
          {
            xo = x;
            c=actual_char_width;
            for( i=0;i<bn;i++ )
            {
-             b = font->p[index++];
+             b = *p++;
              for( k=0;(k<8) && c;k++ )
              {
-               if( b & 0x01 )
+               if( !_UG_IN_CLIP(g,xo,yo) )
+               {
+                  /* Clipped */
+               }
+               else if( b & 0x01 )
                {
-                  gui->pset(xo,yo,fc);
+                  _UG_Pset(g, xo,yo,fc);
                }
                else
                {
-                  gui->pset(xo,yo,bc);
+                  _UG_Pset(g, xo,yo,bc);
                }
                b >>= 1;
                xo++;
@@ -5455,10 +5895,8 @@ void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const
             for( i=0;i<actual_char_width;i++ )
             {
                b = font->p[index++];
-               color = ((((fc & 0x0000FF) * b + (bc & 0x0000FF) * (256 - b)) >> 8) & 0x0000FF) |//Blue component
-                       ((((fc & 0x00FF00) * b + (bc & 0x00FF00) * (256 - b)) >> 8) & 0x00FF00) |//Green component
-                       ((((fc & 0xFF0000) * b + (bc & 0xFF0000) * (256 - b)) >> 8) & 0xFF0000); //Red component
-               gui->pset(xo,yo,color);
+               color = _UG_AA_COLOR(aa,fc,bc,b);
+               if ( _UG_IN_CLIP(g,xo,yo) ) _UG_Pset(g, xo,yo,color);
                xo++;
             }
             index += font->char_width - actual_char_width;
@@ -5468,6 +5906,523 @@ void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const
    }
 }
 
+UG_U8 _UG_MapChar( char chr )
+{
+   UG_U8 bt = (UG_U8)chr;
+
+   switch ( bt )
+   {
+      case 0xF6: bt = 0x94; break; // ö
+      case 0xD6: bt = 0x99; break; // Ö
+      case 0xFC: bt = 0x81; break; // ü
+      case 0xDC: bt = 0x9A; break; // Ü
+      case 0xE4: bt = 0x84; break; // ä
+      case 0xC4: bt = 0x8E; break; // Ä
+      case 0xB5: bt = 0xE6; break; // µ
+      case 0xB0: bt = 0xF8; break; // °
+   }
+
+   return bt;
+}
+
+/* Monospace 1BPP strings on the framebuffer backend: one scanline across all */
+/* glyphs at a time, reported as a single area. Returns 0 if it can't be used */
+/* and nothing was drawn.                                                     */
+UG_U8 _UG_PutStringScanline( UG_GUI* g, UG_S16 x, UG_S16 y, const char* str )
+{
+   const UG_FONT* font = &g->font;
+   const UG_COLOR fc = g->fore_color;
+   const UG_COLOR bc = g->back_color;
+   const UG_S16 cw = font->char_width;
+   const UG_S16 advance = cw + g->char_h_space;
+   UG_S16 glyphs[SCANLINE_MAX_CHARS];
+   UG_S16 count = 0;
+   UG_S16 bn, i, j, k, c, n;
+   UG_COLOR *row, *dst;
+   UG_U8 b, bt;
+   char chr;
+
+   if ( g->fb == NULL || font->widths != NULL || !_UG_FONT_1BPP(font) ) return 0;
+   if ( g->driver[DRIVER_FILL_AREA].state & DRIVER_ENABLED ) return 0;
+   if ( x < g->clip.xs || y < g->clip.ys || y + font->char_height - 1 > g->clip.ye || cw <= 0 ) return 0;
+
+   bn = cw >> 3;
+   if ( cw % 8 ) bn++;
+
+   /* Resolve all glyphs first, -1 leaves a blank like _UG_PutChar does */
+   while ( *str != 0 )
+   {
+      chr = *str++;
+      if (chr < font->start_char || chr > font->end_char) continue;
+      if ( chr == '\n' || count == SCANLINE_MAX_CHARS ) return 0;
+
+      bt = _UG_MapChar(chr);
+      glyphs[count++] = (bt < font->start_char || bt > font->end_char) ? -1 : bt;
+   }
+
+   if ( count == 0 ) return 1;
+
+   /* Would UG_PutString wrap, or is the string clipped? */
+   if ( x + (count - 1) * advance + cw > g->x_dim - 1 ) return 0;
+   if ( x + (count - 1) * advance + cw - 1 > g->clip.xe ) return 0;
+
+   #ifdef USE_GLYPH_CACHE
+   /* Every lookup evicts at most the oldest entry, the glyphs of this string stay put */
+   const UG_COLOR* cached[SCANLINE_MAX_CHARS];
+   UG_U8 use_cache = count <= g->glyph_cache.count;
+
+   for( n=0;n<count && use_cache;n++ )
+   {
+      cached[n] = NULL;
+      if ( glyphs[n] >= 0 && (cached[n] = _UG_GlyphCacheGet(g, glyphs[n], cw, fc, bc, font)) == NULL ) use_cache = 0;
+   }
+
+   /* Compressed glyphs are decoded one at a time, rows can't be interleaved */
+   if ( font->font_type == FONT_TYPE_1BPP_RLE && !use_cache ) return 0;
+   #else
+   if ( font->font_type == FONT_TYPE_1BPP_RLE ) return 0;
+   #endif
+
+   row = g->fb + y * g->fb_stride + x;
+   for( j=0;j<font->char_height;j++ )
+   {
+      for( n=0;n<count;n++ )
+      {
+         dst = row + n * advance;
+         if ( glyphs[n] < 0 ) continue;
+
+         #ifdef USE_GLYPH_CACHE
+         if ( use_cache )
+         {
+            memcpy(dst, cached[n] + j * cw, cw * sizeof(UG_COLOR));
+            continue;
+         }
+         #endif
+
+         const unsigned char* p = font->p + ((glyphs[n] - font->start_char) * font->char_height + j) * bn;
+         if ( g->font_blit != NULL )
+         {
+            g->font_blit(dst, 0, p, 1, fc, bc);
+            continue;
+         }
+
+         c = cw;
+         for( i=0;i<bn;i++ )
+         {
+            b = p[i];
+            for( k=0;(k<8) && c;k++ )
+            {
+               *dst++ = (b & 0x01) ? fc : bc;
+               b >>= 1;
+               c--;
+            }
+         }
+      }
+      row += g->fb_stride;
+   }
+
+   _UG_Invalidate(g, x, y, x + (count - 1) * advance + cw - 1, y + font->char_height - 1);
+   return 1;
+}
+
+#ifdef USE_COLOR_RGB565
+/* Blend two RGB565 colors, a = 0..32. The channels are spread out in one word */
+/* (0x07E0F81F) so all three are weighted with a single pair of multiplies.    */
+UG_COLOR _UG_Blend565( UG_COLOR fc, UG_COLOR bc, UG_U8 a )
+{
+   UG_U32 f = (UG_U16)UG_RGB565(fc);
+   UG_U32 b = (UG_U16)UG_RGB565(bc);
+   UG_U32 r;
+
+   f = (f | (f << 16)) & 0x07E0F81F;
+   b = (b | (b << 16)) & 0x07E0F81F;
+   r = ((f * a + b * (32 - a)) >> 5) & 0x07E0F81F;
+   r = (r | (r >> 16)) & 0xFFFF;
+
+   return UG_RGB565(r);
+}
+
+/* All the blend levels between fc and bc, rebuilt when the colors change */
+const UG_COLOR* _UG_AlphaTable( UG_GUI* g, UG_COLOR fc, UG_COLOR bc )
+{
+   UG_U8 i;
+
+   if ( !g->alpha_table.valid || g->alpha_table.fc != fc || g->alpha_table.bc != bc )
+   {
+      for( i=0;i<ALPHA_LEVELS;i++ )
+      {
+         g->alpha_table.colors[i] = _UG_Blend565(fc, bc, i);
+      }
+      g->alpha_table.fc = fc;
+      g->alpha_table.bc = bc;
+      g->alpha_table.valid = 1;
+   }
+
+   return g->alpha_table.colors;
+}
+#endif
+
+/* Decode a 1BPP glyph into rows of pixels */
+void _UG_ExpandGlyph( UG_GUI* g, UG_COLOR* dst, UG_S16 stride, UG_U8 bt, UG_S16 width, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font )
+{
+   UG_U16 i,j,k,c,bn;
+   UG_U8 b;
+   UG_COLOR* p;
+   const unsigned char* bits = _UG_GlyphBits(g, bt, font);
+
+   if ( bits == NULL ) return;
+
+   bn = font->char_width >> 3;
+   if ( font->char_width % 8 ) bn++;
+
+   if ( g->font_blit != NULL && font->p == g->font.p && width == font->char_width )
+   {
+      g->font_blit(dst, stride, bits, font->char_height, fc, bc);
+      return;
+   }
+
+   for( j=0;j<font->char_height;j++ )
+   {
+      p = dst;
+      c=width;
+      for( i=0;i<bn;i++ )
+      {
+         b = *bits++;
+         for( k=0;(k<8) && c;k++ )
+         {
+            *p++ = (b & 0x01) ? fc : bc;
+            b >>= 1;
+            c--;
+         }
+      }
+      dst += stride;
+   }
+}
+
+/* Rows of 1 bit pixels for glyph bt, compressed fonts are decoded into rle_cache */
+const unsigned char* _UG_GlyphBits( UG_GUI* g, UG_U8 bt, const UG_FONT* font )
+{
+   UG_U16 bn = font->char_width >> 3;
+   if ( font->char_width % 8 ) bn++;
+
+   if ( font->font_type != FONT_TYPE_1BPP_RLE )
+   {
+      return font->p + (bt - font->start_char) * font->char_height * bn;
+   }
+
+   #ifdef USE_RLE_FONTS
+   UG_U8 n;
+   UG_U16 offset;
+
+   if ( !_UG_RLE_FITS(font, bn) ) return NULL;
+
+   for( n=0;n<RLE_CACHE_SLOTS;n++ )
+   {
+      if ( g->rle_cache.font[n] == font->p && g->rle_cache.chr[n] == bt ) return g->rle_cache.bits[n];
+   }
+
+   n = g->rle_cache.next;
+   g->rle_cache.next = (n + 1) % RLE_CACHE_SLOTS;
+
+   /* The data starts with a 16 bit little endian offset for each glyph */
+   offset = font->p[(bt - font->start_char) * 2] | (font->p[(bt - font->start_char) * 2 + 1] << 8);
+   _UG_DecodeRLE(g->rle_cache.bits[n], font->p + offset, font->char_width, font->char_height, bn);
+   g->rle_cache.font[n] = font->p;
+   g->rle_cache.chr[n] = bt;
+
+   return g->rle_cache.bits[n];
+   #else
+   return NULL;
+   #endif
+}
+
+#ifdef USE_RLE_FONTS
+/* Runs of clear and set pixels alternate, starting with a clear one. A run is a */
+/* 4 bit count, high nibble first, or 15 followed by an 8 bit count.             */
+void _UG_DecodeRLE( unsigned char* dst, const unsigned char* src, UG_S16 width, UG_S16 height, UG_U16 bn )
+{
+   UG_U32 nibble = 0;
+   UG_U16 run;
+   UG_S16 x = 0, y = 0;
+   UG_U8 set = 0;
+
+   memset(dst, 0, height * bn);
+
+   while ( y < height )
+   {
+      run = (src[nibble >> 1] >> ((nibble & 1) ? 0 : 4)) & 0x0F;
+      nibble++;
+      if ( run == 0x0F )
+      {
+         run = ((src[nibble >> 1] >> ((nibble & 1) ? 0 : 4)) & 0x0F) << 4;
+         nibble++;
+         run |= (src[nibble >> 1] >> ((nibble & 1) ? 0 : 4)) & 0x0F;
+         nibble++;
+      }
+
+      if ( set )
+      {
+         for( ;run && y < height;run-- )
+         {
+            dst[y * bn + (x >> 3)] |= 1 << (x & 7);
+            if ( ++x == width ) { x = 0; y++; }
+         }
+      }
+      else
+      {
+         x += run;
+         y += x / width;
+         x %= width;
+      }
+      set ^= 1;
+   }
+}
+#endif
+
+#ifdef USE_GLYPH_CACHE
+void _UG_GlyphCacheUnlink( UG_GUI* g, UG_S16 n )
+{
+   UG_GLYPH_CACHE_ENTRY* e = &g->glyph_cache.entries[n];
+
+   if ( e->older >= 0 ) g->glyph_cache.entries[e->older].newer = e->newer;
+   else g->glyph_cache.oldest = e->newer;
+   if ( e->newer >= 0 ) g->glyph_cache.entries[e->newer].older = e->older;
+   else g->glyph_cache.newest = e->older;
+}
+
+void _UG_GlyphCacheTouch( UG_GUI* g, UG_S16 n )
+{
+   UG_GLYPH_CACHE_ENTRY* e = &g->glyph_cache.entries[n];
+
+   e->older = g->glyph_cache.newest;
+   e->newer = -1;
+   if ( g->glyph_cache.newest >= 0 ) g->glyph_cache.entries[g->glyph_cache.newest].newer = n;
+   else g->glyph_cache.oldest = n;
+   g->glyph_cache.newest = n;
+}
+
+UG_U16 _UG_GlyphCacheBucket( const unsigned char* font, UG_U8 chr, UG_COLOR fc, UG_COLOR bc )
+{
+   UG_U32 h = (UG_U32)(uintptr_t)font ^ ((UG_U32)fc << 8) ^ ((UG_U32)bc << 16) ^ chr;
+   h ^= h >> 16;
+   h *= 0x45d9f3b;
+   h ^= h >> 16;
+   return h & (GLYPH_CACHE_BUCKETS - 1);
+}
+
+/* Returns the expanded glyph, NULL if it doesn't fit in a cache slot */
+const UG_COLOR* _UG_GlyphCacheGet( UG_GUI* g, UG_U8 bt, UG_S16 width, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font )
+{
+   UG_U16 bucket;
+   UG_S16 n, *link;
+   UG_GLYPH_CACHE_ENTRY* e;
+
+   if ( g->glyph_cache.count == 0 ) return NULL;
+   if ( width > g->glyph_cache.max_width || font->char_height > g->glyph_cache.max_height ) return NULL;
+
+   bucket = _UG_GlyphCacheBucket(font->p, bt, fc, bc);
+   for( n=g->glyph_cache.buckets[bucket]; n>=0; n=e->next )
+   {
+      e = &g->glyph_cache.entries[n];
+      if ( e->font == font->p && e->chr == bt && e->fc == fc && e->bc == bc )
+      {
+         g->glyph_cache.stats.hits++;
+         _UG_GlyphCacheUnlink(g, n);
+         _UG_GlyphCacheTouch(g, n);
+         return g->glyph_cache.pixels + n * g->glyph_cache.max_width * g->glyph_cache.max_height;
+      }
+   }
+
+   g->glyph_cache.stats.misses++;
+
+   /* Recycle the least recently used entry */
+   n = g->glyph_cache.oldest;
+   e = &g->glyph_cache.entries[n];
+   _UG_GlyphCacheUnlink(g, n);
+
+   if ( e->font != NULL )
+   {
+      link = &g->glyph_cache.buckets[_UG_GlyphCacheBucket(e->font, e->chr, e->fc, e->bc)];
+      while ( *link != n ) link = &g->glyph_cache.entries[*link].next;
+      *link = e->next;
+   }
+
+   e->font = font->p;
+   e->chr = bt;
+   e->fc = fc;
+   e->bc = bc;
+   e->next = g->glyph_cache.buckets[bucket];
+   g->glyph_cache.buckets[bucket] = n;
+   _UG_GlyphCacheTouch(g, n);
+
+   UG_COLOR* pixels = g->glyph_cache.pixels + n * g->glyph_cache.max_width * g->glyph_cache.max_height;
+   _UG_ExpandGlyph(g, pixels, width, bt, width, fc, bc, font);
+   return pixels;
+}
+#endif
+
+void _UG_Invalidate( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2 )
+{
+   if ( g->driver[DRIVER_INVALIDATE].state & DRIVER_ENABLED )
+   {
+      ((void(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2))g->driver[DRIVER_INVALIDATE].driver)(x1,y1,x2,y2);
+   }
+}
+
+/* Box of pixels x1,y1-x2,y2, usually a single row or column. The shape rasterizers */
+/* are built on these so the framebuffer and the drivers get whole runs at a time.  */
+void _UG_Span( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+{
+   UG_S16 n,m;
+
+   if ( x1 < g->clip.xs ) x1 = g->clip.xs;
+   if ( y1 < g->clip.ys ) y1 = g->clip.ys;
+   if ( x2 > g->clip.xe ) x2 = g->clip.xe;
+   if ( y2 > g->clip.ye ) y2 = g->clip.ye;
+   if ( x1 > x2 || y1 > y2 ) return;
+
+   /* Most spans of lines and outlines are a few pixels, skip the fill setup for those */
+   if ( g->fb != NULL && x2 - x1 < 8 && y2 - y1 < 8 )
+   {
+      for( m=y1; m<=y2; m++ )
+      {
+         UG_COLOR* p = g->fb + m * g->fb_stride + x1;
+         for( n=x1; n<=x2; n++ ) *p++ = c;
+      }
+      _UG_Invalidate(g, x1, y1, x2, y2);
+      return;
+   }
+
+   if ( g->fb != NULL )
+   {
+      _UG_FramebufferFill(g, x1,y1,x2,y2,c);
+      return;
+   }
+
+   /* Is hardware acceleration available? */
+   if ( g->driver[DRIVER_FILL_FRAME].state & DRIVER_ENABLED )
+   {
+      if( ((UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))g->driver[DRIVER_FILL_FRAME].driver)(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
+   }
+   /* The line driver draws straight lines only, hand it a box one row at a time */
+   if ( g->driver[DRIVER_DRAW_LINE].state & DRIVER_ENABLED )
+   {
+      UG_RESULT(*line)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c) = (UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))g->driver[DRIVER_DRAW_LINE].driver;
+
+      if ( x1 == x2 )
+      {
+         if( line(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
+      }
+      else
+      {
+         while ( y1 <= y2 && line(x1,y1,x2,y1,c) == UG_RESULT_OK ) y1++;
+         if ( y1 > y2 ) return;
+      }
+   }
+
+   for( m=y1; m<=y2; m++ )
+   {
+      for( n=x1; n<=x2; n++ )
+      {
+         _UG_Pset(g, n,m,c);
+      }
+   }
+}
+
+/* Fills a circle of radius r stretched over the box xl,yt-xr,yb, one row at a time */
+void _UG_FillRoundSpans( UG_GUI* g, UG_S16 xl, UG_S16 yt, UG_S16 xr, UG_S16 yb, UG_S16 r, UG_COLOR c )
+{
+   UG_S16 x,y,xd;
+
+   xd = 3 - (r << 1);
+   x = 0;
+   y = r;
+
+   while ( x <= y )
+   {
+      /* Rows x away from the box are y wide */
+      if ( x > 0 )
+      {
+         _UG_Span(g, xl - y, yt - x, xr + y, yt - x, c);
+         _UG_Span(g, xl - y, yb + x, xr + y, yb + x, c);
+      }
+      if ( xd < 0 )
+      {
+         xd += (x << 2) + 6;
+      }
+      else
+      {
+         /* Rows y away are x wide, this is the last x for them */
+         if ( y > x )
+         {
+            _UG_Span(g, xl - x, yt - y, xr + x, yt - y, c);
+            _UG_Span(g, xl - x, yb + y, xr + x, yb + y, c);
+         }
+         xd += ((x - y) << 2) + 10;
+         y--;
+      }
+      x++;
+   }
+
+   _UG_Span(g, xl - r, yt, xr + r, yb, c);
+}
+
+/* Intersect an area with the clip rectangle, returns 0 if nothing is left */
+UG_U8 _UG_ClipArea( UG_GUI* g, UG_S16* x1, UG_S16* y1, UG_S16* x2, UG_S16* y2 )
+{
+   if ( *x1 < g->clip.xs ) *x1 = g->clip.xs;
+   if ( *y1 < g->clip.ys ) *y1 = g->clip.ys;
+   if ( *x2 > g->clip.xe ) *x2 = g->clip.xe;
+   if ( *y2 > g->clip.ye ) *y2 = g->clip.ye;
+
+   return *x1 <= *x2 && *y1 <= *y2;
+}
+
+/* Plots into the framebuffer of this context, or through its pset driver */
+void _UG_Pset( UG_GUI* g, UG_S16 x, UG_S16 y, UG_COLOR c )
+{
+   if ( g->fb == NULL )
+   {
+      g->pset(x, y, c);
+      return;
+   }
+
+   if ( !_UG_IN_CLIP(g,x,y) ) return;
+
+   g->fb[y * g->fb_stride + x] = c;
+   _UG_Invalidate(g, x, y, x, y);
+}
+
+void _UG_FramebufferFill( UG_GUI* g, UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+{
+   UG_S16 n,m;
+
+   if ( !_UG_ClipArea(g, &x1, &y1, &x2, &y2) ) return;
+
+   for( m=y1; m<=y2; m++ )
+   {
+      UG_COLOR* p = g->fb + m * g->fb_stride + x1;
+      n = x2 - x1 + 1;
+
+      #ifdef USE_COLOR_RGB565
+      /* Two pixels per store once aligned */
+      if ( ((uintptr_t)p & 2) && n > 0 )
+      {
+         *p++ = c;
+         n--;
+      }
+      UG_U32 c2 = ((UG_U32)c << 16) | c;
+      UG_U32* p2 = (UG_U32*)p;
+      for( ; n>=2; n-=2 ) *p2++ = c2;
+      p = (UG_COLOR*)p2;
+      #endif
+
+      while ( n-- > 0 ) *p++ = c;
+   }
+
+   _UG_Invalidate(g, x1, y1, x2, y2);
+}
+
 void _UG_PutText(UG_TEXT* txt)
 {
    UG_U16 sl,rc,wl;
@@ -5536,7 +6491,7 @@ void _UG_PutText(UG_TEXT* txt)
       {
          chr = *str++;
          if ( chr == 0 ) return;
-         _UG_PutChar(chr,xp,yp,txt->fc,txt->bc,txt->font);
+         _UG_PutChar(gui, chr,xp,yp,txt->fc,txt->bc,txt->font);
          xp += (txt->font->widths ? txt->font->widths[chr - txt->font->start_char] : char_width) + char_h_space;
       }
       str++;
@@ -5793,32 +6748,47 @@ void _UG_SendObjectPostrenderEvent(UG_WINDOW *wnd,UG_OBJECT *obj)
 /* -------------------------------------------------------------------------------- */
 /* -- DRIVER FUNCTIONS                                                           -- */
 /* -------------------------------------------------------------------------------- */
-void UG_DriverRegister( UG_U8 type, void* driver )
+void UG_DriverRegisterCtx( UG_GUI* g, UG_U8 type, void* driver )
 {
    if ( type >= NUMBER_OF_DRIVERS ) return;
 
-   gui->driver[type].driver = driver;
-   gui->driver[type].state = DRIVER_REGISTERED | DRIVER_ENABLED;
+   g->driver[type].driver = driver;
+   g->driver[type].state = DRIVER_REGISTERED | DRIVER_ENABLED;
 }
 
-void UG_DriverEnable( UG_U8 type )
+void UG_DriverRegister( UG_U8 type, void* driver )
+{
+   UG_DriverRegisterCtx(gui, type, driver);
+}
+
+void UG_DriverEnableCtx( UG_GUI* g, UG_U8 type )
 {
    if ( type >= NUMBER_OF_DRIVERS ) return;
-   if ( gui->driver[type].state & DRIVER_REGISTERED )
+   if ( g->driver[type].state & DRIVER_REGISTERED )
    {
-      gui->driver[type].state |= DRIVER_ENABLED;
+      g->driver[type].state |= DRIVER_ENABLED;
    }
 }
 
-void UG_DriverDisable( UG_U8 type )
+void UG_DriverEnable( UG_U8 type )
+{
+   UG_DriverEnableCtx(gui, type);
+}
+
+void UG_DriverDisableCtx( UG_GUI* g, UG_U8 type )
 {
    if ( type >= NUMBER_OF_DRIVERS ) return;
-   if ( gui->driver[type].state & DRIVER_REGISTERED )
+   if ( g->driver[type].state & DRIVER_REGISTERED )
    {
-      gui->driver[type].state &= ~DRIVER_ENABLED;
+      g->driver[type].state &= ~DRIVER_ENABLED;
    }
 }
 
+void UG_DriverDisable( UG_U8 type )
+{
+   UG_DriverDisableCtx(gui, type);
+}
+
 /* -------------------------------------------------------------------------------- */
 /* -- MISCELLANEOUS FUNCTIONS                                                    -- */
 /* -------------------------------------------------------------------------------- */
@@ -5885,61 +6855,164 @@ void UG_WaitForUpdate( void )
    #endif    
 }
 
-void UG_DrawBMP( UG_S16 xp, UG_S16 yp, UG_BMP* bmp )
+void UG_DrawBMPCtx( UG_GUI* g, UG_S16 xp, UG_S16 yp, UG_BMP* bmp )
 {
-   UG_S16 x,y,xs;
-   UG_U8 r,g,b;
-   UG_U16* p;
-   UG_U16 tmp;
-   UG_COLOR c;
+   UG_S16 x,y,x1,y1,x2,y2;
+   const UG_U16* p;
+   const UG_U16* src;
+   void(*push_pixel)(UG_COLOR);
 
    if ( bmp->p == NULL ) return;
 
+   if ( bmp->bpp == BMP_BPP_1 )
+   {
+      UG_DrawBMPMaskCtx(g, xp, yp, bmp, g->fore_color, g->back_color, 0);
+      return;
+   }
+
    /* Only support 16 BPP so far */
-   if ( bmp->bpp == BMP_BPP_16 )
-   {
-      p = (UG_U16*)bmp->p;
-   } else if ( bmp->bpp == BMP_BPP_1 ) {
-       UG_U8* p1 = (UG_U8*)bmp->p;
-       c = bmp->colors;
-	for(y=0;y<bmp->height;y++){
-	  for(x=0;x<bmp->width;x++) {
-	      //int by = (x+y*bmp->width) / 8;
-	      //int bi = x+y*bmp->width & 8;
-	      //if ( ((p1[by] >> bi) & 1) == 1 )
-	      if ( p1[x+y*bmp->height] == 0 )
-		  c = C_BLACK;
-	      else
-		  c = C_YELLOW;//bmp->colors;
-	    UG_DrawPixel( xp+x , yp+y , c );
-	  }
-       }
-       return;
-   } else {
+   if ( bmp->bpp != BMP_BPP_16 ) return;
+
+   p = (const UG_U16*)bmp->p;
+
+   x1 = xp;
+   y1 = yp;
+   x2 = xp + bmp->width - 1;
+   y2 = yp + bmp->height - 1;
+   if ( !_UG_ClipArea(g, &x1, &y1, &x2, &y2) ) return;
+
+   if ( g->fb != NULL )
+   {
+      /* Copy whole rows */
+      for( y=y1; y<=y2; y++ )
+      {
+         src = p + (y - yp) * bmp->width + (x1 - xp);
+         UG_COLOR* dst = g->fb + y * g->fb_stride + x1;
+         #if defined(USE_COLOR_RGB565) && !defined(USE_COLOR_RGB565_BE)
+         memcpy(dst, src, (x2 - x1 + 1) * sizeof(UG_COLOR));
+         #else
+         for( x=x1; x<=x2; x++, src++ ) *dst++ = _UG_BMP_COLOR(*src);
+         #endif
+      }
+
+      _UG_Invalidate(g, x1, y1, x2, y2);
+   }
+   else if ( g->driver[DRIVER_FILL_AREA].state & DRIVER_ENABLED )
+   {
+      push_pixel = ((void*(*)(UG_S16, UG_S16, UG_S16, UG_S16))g->driver[DRIVER_FILL_AREA].driver)(x1,y1,x2,y2);
+      for( y=y1; y<=y2; y++ )
+      {
+         src = p + (y - yp) * bmp->width + (x1 - xp);
+         for( x=x1; x<=x2; x++, src++ ) push_pixel(_UG_BMP_COLOR(*src));
+      }
+   }
+   else
+   {
+      for( y=y1; y<=y2; y++ )
+      {
+         src = p + (y - yp) * bmp->width + (x1 - xp);
+         for( x=x1; x<=x2; x++, src++ ) _UG_Pset(g, x, y, _UG_BMP_COLOR(*src));
+      }
+   }
+}
+
+void UG_DrawBMP( UG_S16 xp, UG_S16 yp, UG_BMP* bmp )
+{
+   UG_DrawBMPCtx(gui, xp, yp, bmp);
+}
+
+/* 1 BPP bitmap, rows padded to whole bytes with the leftmost pixel in bit 0, like the */
+/* fonts. Set bits are drawn with fc, clear bits with bc unless transparent is set.   */
+void UG_DrawBMPMaskCtx( UG_GUI* g, UG_S16 xp, UG_S16 yp, const UG_BMP* bmp, UG_COLOR fc, UG_COLOR bc, UG_U8 transparent )
+{
+   UG_S16 x,y,x1,y1,x2,y2,bn;
+   const UG_U8* src;
+   UG_U8 b;
+
+   if ( bmp->p == NULL || bmp->bpp != BMP_BPP_1 ) return;
+
+   bn = (bmp->width + 7) >> 3;
+
+   x1 = xp;
+   y1 = yp;
+   x2 = xp + bmp->width - 1;
+   y2 = yp + bmp->height - 1;
+   if ( !_UG_ClipArea(g, &x1, &y1, &x2, &y2) ) return;
+
+   if ( g->fb != NULL )
+   {
+      const UG_COLOR colors[2] = {bc, fc};
+
+      for( y=y1; y<=y2; y++ )
+      {
+         src = (const UG_U8*)bmp->p + (y - yp) * bn;
+         UG_COLOR* dst = g->fb + y * g->fb_stride + x1;
+         x = x1;
+
+         /* Leading pixels up to a byte boundary of the bitmap */
+         for( ; x<=x2 && ((x - xp) & 7); x++, dst++ )
+         {
+            b = (src[(x - xp) >> 3] >> ((x - xp) & 7)) & 1;
+            if ( b || !transparent ) *dst = colors[b];
+         }
+
+         /* Then 8 pixels per byte */
+         for( ; x+7<=x2; x+=8, dst+=8 )
+         {
+            b = src[(x - xp) >> 3];
+            if ( transparent )
+            {
+               if ( b == 0x00 ) continue;
+               if ( b & 0x01 ) dst[0] = fc;
+               if ( b & 0x02 ) dst[1] = fc;
+               if ( b & 0x04 ) dst[2] = fc;
+               if ( b & 0x08 ) dst[3] = fc;
+               if ( b & 0x10 ) dst[4] = fc;
+               if ( b & 0x20 ) dst[5] = fc;
+               if ( b & 0x40 ) dst[6] = fc;
+               if ( b & 0x80 ) dst[7] = fc;
+            }
+            else
+            {
+               dst[0] = colors[b & 1];
+               dst[1] = colors[(b >> 1) & 1];
+               dst[2] = colors[(b >> 2) & 1];
+               dst[3] = colors[(b >> 3) & 1];
+               dst[4] = colors[(b >> 4) & 1];
+               dst[5] = colors[(b >> 5) & 1];
+               dst[6] = colors[(b >> 6) & 1];
+               dst[7] = colors[b >> 7];
+            }
+         }
+
+         /* Trailing pixels */
+         for( ; x<=x2; x++, dst++ )
+         {
+            b = (src[(x - xp) >> 3] >> ((x - xp) & 7)) & 1;
+            if ( b || !transparent ) *dst = colors[b];
+         }
+      }
+
+      _UG_Invalidate(g, x1, y1, x2, y2);
       return;
    }
 
-   xs = xp;
-   for(y=0;y<bmp->height;y++)
+   for( y=y1; y<=y2; y++ )
    {
-      xp = xs;
-      for(x=0;x<bmp->width;x++)
+      src = (const UG_U8*)bmp->p + (y - yp) * bn;
+      for( x=x1; x<=x2; x++ )
       {
-         tmp = *p++;
-         /* Convert RGB565 to RGB888 */
-         r = (tmp>>11)&0x1F;
-         r<<=3;
-         g = (tmp>>5)&0x3F;
-         g<<=2;
-         b = (tmp)&0x1F;
-         b<<=3;
-         c = ((UG_COLOR)r<<16) | ((UG_COLOR)g<<8) | (UG_COLOR)b;
-         UG_DrawPixel( xp++ , yp , c );
+         if ( (src[(x - xp) >> 3] >> ((x - xp) & 7)) & 1 ) _UG_Pset(g, x, y, fc);
+         else if ( !transparent ) _UG_Pset(g, x, y, bc);
       }
-      yp++;
    }
 }
 
+void UG_DrawBMPMask( UG_S16 xp, UG_S16 yp, const UG_BMP* bmp, UG_COLOR fc, UG_COLOR bc, UG_U8 transparent )
+{
+   UG_DrawBMPMaskCtx(gui, xp, yp, bmp, fc, bc, transparent);
+}
+
 void UG_TouchUpdate( UG_S16 xp, UG_S16 yp, UG_U8 state )
 {
    gui->touch.xp = xp;
@@ -5974,8 +7047,8 @@ UG_RESULT UG_WindowCreate( UG_WINDOW* wnd, UG_OBJECT* objlst, UG_U8 objcnt, void
    wnd->bc = 0xF0F0F0;
    #endif
    #ifdef USE_COLOR_RGB565
-   wnd->fc = 0x0000;
-   wnd->bc = 0xEF7D;
+   wnd->fc = UG_RGB565(0x0000);
+   wnd->bc = UG_RGB565(0xEF7D);
    #endif
    wnd->xs = 0;
    wnd->ys = 0;
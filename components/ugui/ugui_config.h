@@ -12,7 +12,14 @@
 /* Enable color mode */
 //#define USE_COLOR_RGB888   // RGB = 0xFF,0xFF,0xFF
 #define USE_COLOR_RGB565   // RGB = 0bRRRRRGGGGGGBBBBB 
+#define USE_COLOR_RGB565_BE // Store RGB565 colors byte swapped, in the order the LCD expects
 
+/* Only build the fonts and characters the firmware uses, see tools/packfonts.py */
+#define USE_PACKED_FONTS
+
+#ifdef USE_PACKED_FONTS
+#include "ugui_fonts.h"
+#else
 /* Enable needed fonts here */
 #define  USE_FONT_4X6
 #define  USE_FONT_5X8
@@ -32,6 +39,7 @@
 #define  USE_FONT_22X36
 #define  USE_FONT_24X40
 #define  USE_FONT_32X53
+#endif
 
 /* Specify platform-dependent integer types here */
 
@@ -60,6 +68,8 @@ typedef signed long int       UG_S32;
 /* Feature enablers */
 #define USE_PRERENDER_EVENT
 #define USE_POSTRENDER_EVENT
+#define USE_GLYPH_CACHE     // Keep expanded 1BPP glyphs for the framebuffer backend, see UG_GlyphCacheInit()
+#define USE_RLE_FONTS       // Support FONT_TYPE_1BPP_RLE, glyphs are decoded on first use into a small cache
 
 
 #endif
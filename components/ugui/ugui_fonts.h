@@ -0,0 +1,8 @@
+/* Generated by tools/packfonts.py, do not edit. */
+#ifndef __UGUI_FONTS_H
+#define __UGUI_FONTS_H
+
+#define USE_FONT_8X12
+#define USE_FONT_8X8
+
+#endif
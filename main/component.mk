@@ -7,3 +7,8 @@
 # please read the ESP-IDF documents if you need to do this.
 #
 CFLAGS += -DPROJECT_VER="\"$(PROJECT_VER)\""
+
+# spi_device_polling_transmit came with esp-idf 3.3, look for it rather than at the version
+ifneq ($(shell grep -s spi_device_polling_transmit $(IDF_PATH)/components/driver/include/driver/spi_master.h),)
+CFLAGS += -DHAVE_SPI_POLLING_TRANSMIT
+endif
@@ -80,11 +80,18 @@ void input_read(odroid_gamepad_state* out_state)
     xSemaphoreGive(xSemaphore);
 }
 
-uint16_t wait_for_button_press(int ticks)
+int wait_for_button_press(int ticks)
 {
     odroid_gamepad_state previousState;
     input_read(&previousState);
 
+    return wait_for_button_press_from(&previousState, ticks);
+}
+
+// Like wait_for_button_press, but compares against previousState and leaves the
+// last state read in it, so callers waiting in slices don't miss presses between them
+int wait_for_button_press_from(odroid_gamepad_state* previousState, int ticks)
+{
     int timeout = xTaskGetTickCount() + ticks;
     //uint16_t btns = 0;
 
@@ -95,8 +102,9 @@ uint16_t wait_for_button_press(int ticks)
 
         for(int i = 0; i < ODROID_INPUT_MAX; i++)
         {
-            if (!previousState.values[i] && state.values[i]) {
+            if (!previousState->values[i] && state.values[i]) {
                 //btns |= (1 << i);
+                *previousState = state;
                 return i;
             }
         }
@@ -105,11 +113,12 @@ uint16_t wait_for_button_press(int ticks)
         //    return btns;
         //}
 
+        *previousState = state;
+
         if (ticks > 0 && timeout < xTaskGetTickCount()) {
             break;
         }
 
-        previousState = state;
         vTaskDelay(10 / portTICK_PERIOD_MS);
     }
 
@@ -37,5 +37,6 @@ typedef struct
 
 void input_init();
 void input_read(odroid_gamepad_state* out_state);
-uint16_t wait_for_button_press();
+int wait_for_button_press(int ticks);
+int wait_for_button_press_from(odroid_gamepad_state* previousState, int ticks);
 odroid_gamepad_state input_read_raw();
@@ -1,5 +1,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <esp_system.h>
 #include <esp_event.h>
 #include <esp_adc_cal.h>
@@ -76,6 +78,28 @@
 
 #define ITEM_COUNT (4)
 
+#define DIRTY_RECTS_MAX (8)
+#define DIRTY_MERGE_SLACK (320) // Pixels we're willing to resend to save a rectangle (one line)
+#define FILL_RECTS_MAX (8)
+#define RUN_MIN_PIXELS (256) // Smaller solid runs aren't worth a window setup of their own
+#define PRESENT_QUEUE_SIZE (2)
+#define GLYPH_CACHE_SIZE (64 * 1024) // About 300 8x12 glyphs
+#define FW_CACHE_ENTRIES (1024) // As many files as odroid_sdcard_files_get returns
+#define FW_CACHE_TILES (128) // 8KB each, the tiles of 32 pages
+#define FW_TILE_PLACEHOLDER (0xD69A) // C_LIGHT_GRAY as tiles store it
+#define FW_INDEX_PATH_SIZE (128)
+#define FW_LOADER_PATH_SIZE (256)
+#define FW_LOADER_POLL_TICKS (2) // How often rows waiting for the loader are checked
+#define UI_IDLE_TICKS (10) // How often an idle browser looks for a battery change
+
+#define FW_PEEK_SUMMARY (1 << 0) // Known, maybe from the index
+#define FW_PEEK_CURRENT (1 << 1) // Checked against the file this session
+#define FW_PEEK_TILE    (1 << 2)
+
+#define DIFF_TILE_SIZE (16)
+#define DIFF_TILES_X (320 / DIFF_TILE_SIZE)
+#define DIFF_TILES_Y (240 / DIFF_TILE_SIZE)
+
 #define LED_ON() gpio_set_level(GPIO_NUM_2, 1);
 #define LED_OFF() gpio_set_level(GPIO_NUM_2, 0);
 
@@ -84,6 +108,7 @@
 
 //const char* HEADER = "ODROIDGO_FIRMWARE_V00_00";
 const char* HEADER_V00_01 = "ODROIDGO_FIRMWARE_V00_01";
+const char* INDEX_V00_01 = "ODROIDGO_FW_INDEX_V00_01";
 
 extern const esp_app_desc_t esp_app_desc;
 
@@ -143,6 +168,36 @@ typedef struct
     size_t offset;
     size_t size;
 } odroid_flash_block_t;
+
+// What the file browser shows of a firmware file, see firmware_cache_load
+typedef struct
+{
+    char *path;
+    uint32_t hash;
+    size_t fileSize;
+    time_t mtime;
+    size_t flashSize;
+    char description[FIRMWARE_DESCRIPTION_SIZE];
+    uint32_t checksum;
+    bool valid;
+    bool indexed;           // Has its record in the index, see firmware_index_open
+    int16_t tile;           // Slot in fwCacheTiles, -1 if it has to be read again
+    uint32_t lastUse;
+    uint32_t session;       // fwCacheSession the file was last checked in
+} odroid_fw_summary_t;
+
+// Record n of .index describes fwCache[n], its tile is tile n of .tiles
+typedef struct
+{
+    char path[FW_INDEX_PATH_SIZE];
+    uint32_t fileSize;
+    uint32_t mtime;
+    uint32_t flashSize;
+    uint32_t checksum;
+    char description[FIRMWARE_DESCRIPTION_SIZE];
+    uint8_t valid;
+    uint8_t _reserved[3];
+} odroid_fw_index_t;
 // ------
 
 typedef struct
@@ -152,6 +207,37 @@ typedef struct
     bool enabled;
 } dialog_option_t;
 
+typedef struct
+{
+    short left;
+    short top;
+    short right;
+    short bottom;
+} ui_rect_t;
+
+typedef struct
+{
+    ui_rect_t rect;
+    UG_COLOR color;
+} ui_fill_t;
+
+typedef struct
+{
+    ui_fill_t fills[FILL_RECTS_MAX];
+    ui_rect_t rects[DIRTY_RECTS_MAX];
+    uint8_t fillCount;
+    uint8_t rectCount;
+    bool diff;              // Let the tile differ find what changed instead
+    TaskHandle_t notify;    // Notified once the present is on the panel
+} ui_present_t;
+
+typedef enum
+{
+    UI_PRESENT_DIRTY_RECTS, // Send the rectangles reported by uGUI and fills
+    UI_PRESENT_TILE_DIFF,   // Hash fb tiles and send the ones that changed since the last present
+    UI_PRESENT_RUNS,        // Fills are only damage, solid areas of the final rectangles are sent as fills
+} ui_present_mode_t;
+
 static odroid_app_t* apps;
 static int apps_count = -1;
 static int apps_max = 4;
@@ -164,9 +250,37 @@ static int startTableEntry = -1;
 static int startFlashAddress = -1;
 
 static odroid_fw_t *fwInfoBuffer;
+static uint16_t *tileBuffer;
 static uint8_t *dataBuffer;
 
-static uint16_t fb[320 * 240];
+static odroid_fw_summary_t *fwCache;
+static int fwCacheCount = 0;
+static uint16_t *fwCacheTiles;
+static int16_t fwCacheTileOwner[FW_CACHE_TILES];
+static uint32_t fwCacheClock = 0;
+static uint32_t fwCacheSession = 0;
+static FILE *fwIndexFile;
+static FILE *fwIndexTiles;
+static SemaphoreHandle_t fwCacheLock;   // Held by the loader while changing the cache, see firmware_cache_load
+static TaskHandle_t fwLoaderTask;
+static SemaphoreHandle_t fwLoaderIdle;
+static odroid_fw_t *fwLoaderBuffer;
+static char fwLoaderWanted[ITEM_COUNT * 3][FW_LOADER_PATH_SIZE]; // The page, then the pages either side
+static int fwLoaderWantedCount = 0;
+static int fwLoaderPageCount = 0;
+static uint32_t fwLoaderGeneration = 0; // Bumped whenever fwLoaderWanted changes
+static volatile int fwLoaderProgress = 0;
+
+DMA_ATTR static uint16_t fb[320 * 240];
+static ui_rect_t dirtyRects[DIRTY_RECTS_MAX];
+static int dirtyCount = 0;
+static ui_fill_t fillRects[FILL_RECTS_MAX];
+static int fillCount = 0;
+static uint32_t *tileHashes;
+static ui_present_mode_t presentMode = UI_PRESENT_DIRTY_RECTS;
+static QueueHandle_t presentQueue;
+static int presentsQueued = 0;
+static volatile int presentsDone = 0;
 static UG_GUI gui;
 static char tempstring[512];
 
@@ -175,6 +289,7 @@ static esp_err_t sdcardret;
 static nvs_handle nvs_h;
 
 static int batteryPercent = 0;
+static volatile bool batteryChanged = false; // Set by battery_task, see ui_wait_for_button
 
 
 static void battery_task(void *arg)
@@ -201,11 +316,18 @@ static void battery_task(void *arg)
 
         double voltage = (double) esp_adc_cal_raw_to_voltage(total / count, &adc_cal) * 2 / 1000;
 
-        batteryPercent = 101 - (101 / pow(1 + pow(1.33 * ((int)(voltage * 100) - BATTERY_VMIN)
-                                                            / (BATTERY_VMAX - BATTERY_VMIN), 4.5), 3));
+        int percent = 101 - (101 / pow(1 + pow(1.33 * ((int)(voltage * 100) - BATTERY_VMIN)
+                                                     / (BATTERY_VMAX - BATTERY_VMIN), 4.5), 3));
 
-        if (batteryPercent >= 100)
-            batteryPercent = 100;
+        if (percent >= 100)
+            percent = 100;
+
+        // The UI only redraws the indicator when told
+        if (percent != batteryPercent)
+        {
+            batteryPercent = percent;
+            batteryChanged = true;
+        }
 
         if (++loops > count)
             vTaskDelay(25);
@@ -223,26 +345,467 @@ void indicate_error()
     }
 }
 
-static void pset(UG_S16 x, UG_S16 y, UG_COLOR color)
+static inline int ui_rect_area(const ui_rect_t *r)
+{
+    return (r->right - r->left + 1) * (r->bottom - r->top + 1);
+}
+
+static inline void ui_rect_union(ui_rect_t *dst, const ui_rect_t *src)
+{
+    if (src->left < dst->left) dst->left = src->left;
+    if (src->top < dst->top) dst->top = src->top;
+    if (src->right > dst->right) dst->right = src->right;
+    if (src->bottom > dst->bottom) dst->bottom = src->bottom;
+}
+
+static inline bool ui_rect_contains(const ui_rect_t *outer, const ui_rect_t *inner)
+{
+    return inner->left >= outer->left && inner->right <= outer->right
+        && inner->top >= outer->top && inner->bottom <= outer->bottom;
+}
+
+// Extra pixels that would be sent if both rectangles were merged
+static int ui_rect_merge_cost(const ui_rect_t *a, const ui_rect_t *b)
+{
+    ui_rect_t u = *a;
+    ui_rect_union(&u, b);
+    return ui_rect_area(&u) - ui_rect_area(a) - ui_rect_area(b);
+}
+
+static void ui_invalidate(short left, short top, short right, short bottom)
+{
+    if (left < 0) left = 0;
+    if (top < 0) top = 0;
+    if (right > 319) right = 319;
+    if (bottom > 239) bottom = 239;
+    if (left > right || top > bottom) return;
+
+    ui_rect_t rect = {left, top, right, bottom};
+
+    // Fast path for consecutive pixels of the same primitive
+    if (dirtyCount > 0 && ui_rect_contains(&dirtyRects[dirtyCount - 1], &rect))
+        return;
+
+    // Fold the rectangle into the cheapest neighbour, keep the merged one last
+    int best = -1, bestCost = DIRTY_MERGE_SLACK + 1;
+    for (int i = 0; i < dirtyCount; ++i)
+    {
+        int cost = ui_rect_merge_cost(&dirtyRects[i], &rect);
+        if (cost < bestCost)
+        {
+            best = i;
+            bestCost = cost;
+        }
+    }
+
+    if (best < 0 && dirtyCount < DIRTY_RECTS_MAX)
+    {
+        dirtyRects[dirtyCount++] = rect;
+        return;
+    }
+
+    if (best < 0)
+    {
+        // Out of slots, grow whichever rectangle is least affected
+        for (int i = 0; i < dirtyCount; ++i)
+        {
+            int cost = ui_rect_merge_cost(&dirtyRects[i], &rect);
+            if (best < 0 || cost < bestCost)
+            {
+                best = i;
+                bestCost = cost;
+            }
+        }
+    }
+
+    ui_rect_union(&rect, &dirtyRects[best]);
+    dirtyRects[best] = dirtyRects[--dirtyCount];
+
+    // The grown rectangle may now swallow others
+    for (int i = dirtyCount - 1; i >= 0; --i)
+    {
+        if (ui_rect_merge_cost(&dirtyRects[i], &rect) <= DIRTY_MERGE_SLACK)
+        {
+            ui_rect_union(&rect, &dirtyRects[i]);
+            dirtyRects[i] = dirtyRects[--dirtyCount];
+        }
+    }
+
+    dirtyRects[dirtyCount++] = rect;
+}
+
+// Solid fills are streamed by the driver from a single block of color, fb isn't read.
+// They are sent in order before the dirty rectangles, which always come from fb.
+static void ui_invalidate_fill(const ui_rect_t *rect, UG_COLOR color)
+{
+    // Anything the fill covers entirely doesn't need to be sent anymore
+    for (int i = dirtyCount - 1; i >= 0; --i)
+    {
+        if (ui_rect_contains(rect, &dirtyRects[i]))
+            dirtyRects[i] = dirtyRects[--dirtyCount];
+    }
+
+    for (int i = fillCount - 1; i >= 0; --i)
+    {
+        if (ui_rect_contains(rect, &fillRects[i].rect))
+        {
+            memmove(&fillRects[i], &fillRects[i + 1], (fillCount - i - 1) * sizeof(ui_fill_t));
+            fillCount--;
+        }
+    }
+
+    if (fillCount < FILL_RECTS_MAX)
+    {
+        fillRects[fillCount++] = (ui_fill_t){*rect, color};
+    }
+    else
+    {
+        // Out of slots, send it from fb like any other pixel
+        ui_invalidate(rect->left, rect->top, rect->right, rect->bottom);
+    }
+}
+
+static UG_RESULT ui_fill_frame(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR color)
+{
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 > 319) x2 = 319;
+    if (y2 > 239) y2 = 239;
+    if (x1 > x2 || y1 > y2) return UG_RESULT_OK;
+
+    // fb still has to be updated, later pixels may be sent from around the fill
+    for (short y = y1; y <= y2; ++y)
+    {
+        uint16_t *row = &fb[y * 320];
+        for (short x = x1; x <= x2; ++x)
+        {
+            row[x] = color;
+        }
+    }
+
+    // ui_send_runs finds the solid areas in fb on its own, overlapping fills are then
+    // only sent once, as whatever ended up on top
+    if (presentMode == UI_PRESENT_RUNS)
+    {
+        ui_invalidate(x1, y1, x2, y2);
+    }
+    else if (presentMode != UI_PRESENT_TILE_DIFF)
+    {
+        ui_invalidate_fill(&(ui_rect_t){x1, y1, x2, y2}, color);
+    }
+
+    return UG_RESULT_OK;
+}
+
+static void ui_send_rect(short left, short top, short right, short bottom)
+{
+#ifdef USE_COLOR_RGB565_BE
+    // fb is in panel order, keep rows 32bit aligned so they can be DMA'd in place
+    left &= ~1;
+    right |= 1;
+    ili9341_write_frame_rectangle_strided(left, top,
+        right - left + 1, bottom - top + 1, &fb[top * 320 + left], 320);
+#else
+    ili9341_write_frame_rectangleLE_strided(left, top,
+        right - left + 1, bottom - top + 1, &fb[top * 320 + left], 320);
+#endif
+}
+
+static void ui_send_fill(const ui_fill_t *fill)
+{
+    const ui_rect_t *r = &fill->rect;
+#ifdef USE_COLOR_RGB565_BE
+    uint16_t color = fill->color;
+#else
+    uint16_t color = fill->color << 8 | fill->color >> 8;
+#endif
+    ili9341_fill_rect(r->left, r->top, r->right - r->left + 1, r->bottom - r->top + 1, color);
+}
+
+static bool ui_span_is_solid(const uint16_t *p, int count, int step, UG_COLOR *color)
+{
+    for (int i = 1; i < count; ++i)
+    {
+        if (p[i * step] != p[0]) return false;
+    }
+
+    *color = p[0];
+    return true;
+}
+
+// Split a band of rows in columns, uniform columns become fills
+static void ui_send_band(short left, short top, short right, short bottom)
+{
+    const int height = bottom - top + 1;
+    const uint16_t *base = &fb[top * 320];
+    short spanStart = left;
+    short x = left;
+    UG_COLOR color, next;
+
+    while (x <= right)
+    {
+        if (!ui_span_is_solid(base + x, height, 320, &color))
+        {
+            ++x;
+            continue;
+        }
+
+        short end = x;
+        while (end < right && ui_span_is_solid(base + end + 1, height, 320, &next) && next == color)
+            ++end;
+
+        if ((end - x + 1) * height >= RUN_MIN_PIXELS)
+        {
+            if (spanStart < x)
+                ui_send_rect(spanStart, top, x - 1, bottom);
+
+            ui_send_fill(&(ui_fill_t){{x, top, end, bottom}, color});
+            spanStart = end + 1;
+        }
+
+        x = end + 1;
+    }
+
+    if (spanStart <= right)
+        ui_send_rect(spanStart, top, right, bottom);
+}
+
+// Send uniform rows of a rectangle as fills, the rows in between go through ui_send_band
+static void ui_send_runs(const ui_rect_t *r)
+{
+    const int width = r->right - r->left + 1;
+    short bandStart = r->top;
+    short y = r->top;
+    UG_COLOR color, next;
+
+    while (y <= r->bottom)
+    {
+        if (!ui_span_is_solid(&fb[y * 320 + r->left], width, 1, &color))
+        {
+            ++y;
+            continue;
+        }
+
+        short end = y;
+        while (end < r->bottom && ui_span_is_solid(&fb[(end + 1) * 320 + r->left], width, 1, &next) && next == color)
+            ++end;
+
+        if ((end - y + 1) * width >= RUN_MIN_PIXELS)
+        {
+            if (bandStart < y)
+                ui_send_band(r->left, bandStart, r->right, y - 1);
+
+            ui_send_fill(&(ui_fill_t){{r->left, y, r->right, end}, color});
+            bandStart = end + 1;
+        }
+
+        y = end + 1;
+    }
+
+    if (bandStart <= r->bottom)
+        ui_send_band(r->left, bandStart, r->right, r->bottom);
+}
+
+static uint32_t ui_tile_hash(int tx, int ty)
+{
+    uint32_t hash = 2166136261u; // FNV-1a, one word (two pixels) at a time
+
+    for (int y = 0; y < DIFF_TILE_SIZE; ++y)
+    {
+        const uint32_t *p = (const uint32_t*)&fb[(ty * DIFF_TILE_SIZE + y) * 320 + tx * DIFF_TILE_SIZE];
+        for (int x = 0; x < DIFF_TILE_SIZE / 2; ++x)
+        {
+            hash = (hash ^ p[x]) * 16777619u;
+        }
+    }
+
+    return hash;
+}
+
+// Send a rectangle given in tile units, returns the number of bytes sent
+static int ui_send_tiles(const ui_rect_t *r)
+{
+    ui_send_rect(r->left * DIFF_TILE_SIZE, r->top * DIFF_TILE_SIZE,
+        (r->right + 1) * DIFF_TILE_SIZE - 1, (r->bottom + 1) * DIFF_TILE_SIZE - 1);
+
+    return ui_rect_area(r) * DIFF_TILE_SIZE * DIFF_TILE_SIZE * 2;
+}
+
+static void ui_update_display_diff()
+{
+    ui_rect_t open[DIFF_TILES_X];
+    int openCount = 0;
+    int bytesSent = 0;
+
+    for (int ty = 0; ty < DIFF_TILES_Y; ++ty)
+    {
+        ui_rect_t runs[DIFF_TILES_X];
+        int runCount = 0;
+
+        // Find runs of changed tiles on this row
+        for (int tx = 0; tx < DIFF_TILES_X; ++tx)
+        {
+            uint32_t hash = ui_tile_hash(tx, ty);
+            if (hash == tileHashes[ty * DIFF_TILES_X + tx]) continue;
+            tileHashes[ty * DIFF_TILES_X + tx] = hash;
+
+            if (runCount > 0 && runs[runCount - 1].right == tx - 1)
+                runs[runCount - 1].right = tx;
+            else
+                runs[runCount++] = (ui_rect_t){tx, ty, tx, ty};
+        }
+
+        // Runs matching one from the row above extend it, the others start a new rectangle
+        ui_rect_t next[DIFF_TILES_X];
+        int nextCount = 0;
+
+        for (int i = 0; i < runCount; ++i)
+        {
+            for (int j = 0; j < openCount; ++j)
+            {
+                if (open[j].left == runs[i].left && open[j].right == runs[i].right)
+                {
+                    runs[i].top = open[j].top;
+                    open[j] = open[--openCount];
+                    break;
+                }
+            }
+            next[nextCount++] = runs[i];
+        }
+
+        // Whatever wasn't extended is complete
+        for (int j = 0; j < openCount; ++j)
+        {
+            bytesSent += ui_send_tiles(&open[j]);
+        }
+
+        memcpy(open, next, nextCount * sizeof(ui_rect_t));
+        openCount = nextCount;
+    }
+
+    for (int j = 0; j < openCount; ++j)
+    {
+        bytesSent += ui_send_tiles(&open[j]);
+    }
+
+    ESP_LOGD(__func__, "Sent %d bytes, saved %d bytes", bytesSent, (int)sizeof(fb) - bytesSent);
+}
+
+// Owns the panel once ui_init is done. fb may change under us while a present is being
+// sent, that's fine: whatever was drawn since is part of the next present anyway.
+static void display_task(void *arg)
 {
-    fb[y * 320 + x] = color;
+    ui_present_t present;
+
+    while (xQueueReceive(presentQueue, &present, portMAX_DELAY) == pdTRUE)
+    {
+        ili9341_begin_present();
+
+        if (present.diff)
+        {
+            ui_update_display_diff();
+        }
+
+        for (int i = 0; i < present.fillCount; ++i)
+        {
+            ui_send_fill(&present.fills[i]);
+        }
+
+        // Only push what changed since the last update, straight out of fb
+        for (int i = 0; i < present.rectCount; ++i)
+        {
+            ui_rect_t *r = &present.rects[i];
+            if (presentMode == UI_PRESENT_RUNS)
+                ui_send_runs(r);
+            else
+                ui_send_rect(r->left, r->top, r->right, r->bottom);
+        }
+
+        ili9341_end_present();
+
+        presentsDone++;
+        if (present.notify)
+            xTaskNotifyGive(present.notify);
+    }
+
+    vTaskDelete(NULL);
 }
 
+// Hand the pending changes over to the display task, returns without waiting for them
 static void ui_update_display()
 {
-    ili9341_write_frame_rectangleLE(0, 0, 320, 240, fb);
+    ui_present_t present;
+
+    present.diff = (presentMode == UI_PRESENT_TILE_DIFF);
+    present.fillCount = present.diff ? 0 : fillCount;
+    present.rectCount = present.diff ? 0 : dirtyCount;
+    present.notify = xTaskGetCurrentTaskHandle();
+
+    memcpy(present.fills, fillRects, present.fillCount * sizeof(ui_fill_t));
+    memcpy(present.rects, dirtyRects, present.rectCount * sizeof(ui_rect_t));
+
+    fillCount = 0;
+    dirtyCount = 0;
+
+    if (present.diff || present.fillCount > 0 || present.rectCount > 0)
+    {
+        presentsQueued++;
+        xQueueSend(presentQueue, &present, portMAX_DELAY);
+    }
+}
+
+// Block until everything handed to the display task is on the panel
+static void ui_wait_display()
+{
+    while (presentsDone != presentsQueued)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
 }
 
-static void ui_draw_image(short x, short y, short width, short height, uint16_t* data)
+static void ui_init(ui_present_mode_t mode)
 {
-    for (short i = 0 ; i < height; ++i)
+    if (mode == UI_PRESENT_TILE_DIFF)
     {
-        for (short j = 0; j < width; ++j)
+        tileHashes = calloc(DIFF_TILES_X * DIFF_TILES_Y, sizeof(uint32_t));
+        if (!tileHashes)
         {
-            uint16_t pixel = data[i * width + j];
-            UG_DrawPixel(x + j, y + i, pixel);
+            ESP_LOGE(__func__, "Tile hashes allocation failed, using dirty rectangles.");
+            mode = UI_PRESENT_DIRTY_RECTS;
         }
     }
+
+    presentMode = mode;
+
+    UG_InitFramebuffer(&gui, fb, 320, 240, 320);
+
+    // PSRAM is plenty for this, internal memory is kept for DMA
+    void *glyphCache = heap_caps_malloc(GLYPH_CACHE_SIZE, MALLOC_CAP_SPIRAM);
+    if (!glyphCache)
+    {
+        ESP_LOGW(__func__, "Glyph cache allocation failed, text will be decoded every time.");
+    }
+    UG_GlyphCacheInit(glyphCache, glyphCache ? GLYPH_CACHE_SIZE : 0, 8, 12);
+
+    // The differ finds changes by itself, don't pay for tracking them
+    if (mode != UI_PRESENT_TILE_DIFF)
+    {
+        UG_DriverRegister(DRIVER_INVALIDATE, (void*)&ui_invalidate);
+        UG_DriverRegister(DRIVER_FILL_FRAME, (void*)&ui_fill_frame);
+    }
+
+    // Anything still streaming from ili9341_clear has to be done before the task takes over
+    ili9341_wait_frame();
+
+    // input_task runs on core 1
+    presentQueue = xQueueCreate(PRESENT_QUEUE_SIZE, sizeof(ui_present_t));
+    xTaskCreatePinnedToCore(&display_task, "display_task", 1024 * 3, NULL, 5, NULL, 0);
+}
+
+static void ui_draw_image(short x, short y, short width, short height, uint16_t* data)
+{
+    UG_BMP bmp = {data, width, height, BMP_BPP_16, BMP_RGB565};
+    UG_DrawBMP(x, y, &bmp);
 }
 
 static void ui_draw_title(char*, char*);
@@ -360,6 +923,7 @@ void cleanup_and_restart()
     gpio_set_direction(GPIO_NUM_2, GPIO_MODE_INPUT);
 
     // clear and deinit display
+    ui_wait_display();
     ili9341_clear(0x0000);
     ili9341_deinit();
 
@@ -851,48 +1415,594 @@ firmware_get_info_err:
 }
 
 
-void flash_utility()
-{
-    // Code to flash utility.bin.
-    // Because leaving it in flash_firmware results in multiple copies being flashed.
-    //FILE* util = fopen("/sd/odroid/utility.bin", "rb");
-    //util_part.type = ESP_PARTITION_TYPE_APP;
-    //util_part.subtype = ESP_PARTITION_SUBTYPE_APP_TEST;
-}
-
+static void firmware_index_close();
+static void firmware_loader_task(void *arg);
 
-void flash_firmware(const char* fullPath)
+static void firmware_cache_init()
 {
-    ESP_LOGD(__func__, "HEAP=%#010x", esp_get_free_heap_size());
-    LED_OFF();
+    // About 1MB, PSRAM is plenty for this
+    fwCache = heap_caps_calloc(FW_CACHE_ENTRIES, sizeof(odroid_fw_summary_t), MALLOC_CAP_SPIRAM);
+    fwCacheTiles = heap_caps_malloc(FW_CACHE_TILES * FIRMWARE_TILE_SIZE * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
 
-    size_t count;
-    bool can_proceed = true;
+    if (!fwCache || !fwCacheTiles)
+    {
+        ESP_LOGW(__func__, "Firmware cache allocation failed, files will be parsed on every redraw.");
+        free(fwCache);
+        free(fwCacheTiles);
+        fwCache = NULL;
+        fwCacheTiles = NULL;
+    }
 
-    sort_app_table(APP_SORT_OFFSET);
+    for (int i = 0; i < FW_CACHE_TILES; ++i)
+    {
+        fwCacheTileOwner[i] = -1;
+    }
 
-    ui_draw_title("Install Application", "Destination: Pending");
-    UpdateDisplay();
+    if (!fwCache) return;
 
-    ESP_LOGI(__func__, "Flashing file: %s", fullPath);
+    fwLoaderBuffer = heap_caps_malloc(sizeof(odroid_fw_t), MALLOC_CAP_SPIRAM);
+    fwCacheLock = xSemaphoreCreateMutex();
+    fwLoaderIdle = xSemaphoreCreateBinary();
 
-    FILE* file = fopen(fullPath, "rb");
-    if (file == NULL)
+    if (!fwLoaderBuffer || !fwCacheLock || !fwLoaderIdle)
     {
-        DisplayError("FILE OPEN ERROR");
+        DisplayError("MEMORY ALLOCATION ERROR");
         indicate_error();
     }
 
-    odroid_fw_t *fw = fwInfoBuffer;
+    // Same priority as the UI, which mostly sleeps in wait_for_button_press
+    xTaskCreate(&firmware_loader_task, "loader_task", 4096, NULL, 1, &fwLoaderTask);
+}
 
-    if (!firmware_get_info(fullPath, fw))
+static uint32_t firmware_cache_hash(const char* path)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    while (*path)
     {
-        // To do: Make it show what is invalid
-        DisplayError("INVALID FIRMWARE FILE");
-        can_proceed = false;
+        hash = (hash ^ (uint8_t)*path++) * 16777619u;
     }
 
-    int currentFlashAddress = find_free_block(fw->flashSize, true);
+    return hash;
+}
+
+// Persists entry and its tile at its position in the index, if one is open. The loader
+// calls it without fwCacheLock: the entry and tile are copied under it, then written.
+static void firmware_index_write(odroid_fw_summary_t *entry)
+{
+    odroid_fw_index_t record, hole;
+    uint16_t *tile = fwLoaderBuffer->fileHeader.tile; // The loader's own, done with once parsed
+    size_t tileSize = FIRMWARE_TILE_SIZE * sizeof(uint16_t);
+    int n = entry - fwCache;
+
+    xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+
+    entry->indexed = false;
+
+    if (!fwIndexFile || strlen(entry->path) >= FW_INDEX_PATH_SIZE)
+    {
+        xSemaphoreGive(fwCacheLock);
+        return;
+    }
+
+    memset(&record, 0, sizeof(record));
+    strcpy(record.path, entry->path);
+    record.fileSize = entry->fileSize;
+    record.mtime = entry->mtime;
+    record.flashSize = entry->flashSize;
+    record.checksum = entry->checksum;
+    memcpy(record.description, entry->description, FIRMWARE_DESCRIPTION_SIZE);
+    record.valid = entry->valid;
+    memcpy(tile, &fwCacheTiles[entry->tile * FIRMWARE_TILE_SIZE], tileSize);
+
+    xSemaphoreGive(fwCacheLock);
+
+    // Slot n may hold another file: its record goes first so the new tile is never read
+    // for it, then the tile, then the record that makes the tile trusted
+    memset(&hole, 0, sizeof(hole));
+
+    if (fseek(fwIndexFile, FIRMWARE_HEADER_SIZE + n * sizeof(hole), SEEK_SET) != 0 ||
+        fwrite(&hole, sizeof(hole), 1, fwIndexFile) != 1 ||
+        fflush(fwIndexFile) != 0 ||
+        fseek(fwIndexTiles, n * tileSize, SEEK_SET) != 0 ||
+        fwrite(tile, tileSize, 1, fwIndexTiles) != 1 ||
+        fflush(fwIndexTiles) != 0 ||
+        fseek(fwIndexFile, FIRMWARE_HEADER_SIZE + n * sizeof(record), SEEK_SET) != 0 ||
+        fwrite(&record, sizeof(record), 1, fwIndexFile) != 1 ||
+        fflush(fwIndexFile) != 0)
+    {
+        ESP_LOGE(__func__, "Index write failed for %s", record.path);
+        return;
+    }
+
+    xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+    entry->indexed = true;
+    xSemaphoreGive(fwCacheLock);
+}
+
+// Entry for path, taking over the least recently used one when full
+static odroid_fw_summary_t* firmware_cache_add(const char* path, uint32_t hash)
+{
+    odroid_fw_summary_t *entry = &fwCache[0];
+
+    if (fwCacheCount < FW_CACHE_ENTRIES)
+    {
+        entry = &fwCache[fwCacheCount++];
+        entry->tile = -1;
+    }
+    else
+    {
+        for (int i = 1; i < FW_CACHE_ENTRIES; ++i)
+        {
+            if (fwCache[i].lastUse < entry->lastUse) entry = &fwCache[i];
+        }
+        free(entry->path);
+    }
+
+    entry->path = strdup(path);
+    if (!entry->path) abort();
+
+    entry->hash = hash;
+    entry->indexed = false;
+    return entry;
+}
+
+// Opens the index of the firmware files in path, kept up to date by firmware_cache_load
+// until firmware_index_close. The first time, the cache is filled from it so a page
+// only costs a stat per file until something changes.
+static void firmware_index_open(const char* path)
+{
+    char header[FIRMWARE_HEADER_SIZE];
+
+    if (!fwCache) return;
+
+    sprintf(tempstring, "%s/.index", path);
+    fwIndexFile = fopen(tempstring, "r+b");
+    sprintf(tempstring, "%s/.tiles", path);
+    fwIndexTiles = fopen(tempstring, "r+b");
+
+    if (!fwIndexFile || !fwIndexTiles ||
+        fread(header, sizeof(header), 1, fwIndexFile) != 1 ||
+        memcmp(header, INDEX_V00_01, FIRMWARE_HEADER_SIZE) != 0)
+    {
+        ESP_LOGI(__func__, "Creating a new index in %s", path);
+
+        if (fwIndexFile) fclose(fwIndexFile);
+        if (fwIndexTiles) fclose(fwIndexTiles);
+
+        sprintf(tempstring, "%s/.index", path);
+        fwIndexFile = fopen(tempstring, "w+b");
+        sprintf(tempstring, "%s/.tiles", path);
+        fwIndexTiles = fopen(tempstring, "w+b");
+
+        if (!fwIndexFile || !fwIndexTiles || fwrite(INDEX_V00_01, FIRMWARE_HEADER_SIZE, 1, fwIndexFile) != 1)
+        {
+            ESP_LOGE(__func__, "Index creation failed.");
+            firmware_index_close();
+        }
+
+        // Whatever is cached was indexed in the old one, firmware_cache_load writes it again
+        xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+        for (int i = 0; i < fwCacheCount; ++i)
+            fwCache[i].indexed = false;
+        xSemaphoreGive(fwCacheLock);
+
+        return;
+    }
+
+    // Already in the cache from an earlier visit
+    if (fwCacheCount > 0) return;
+
+    const int chunk = 32;
+    odroid_fw_index_t *records = malloc(chunk * sizeof(odroid_fw_index_t));
+    if (!records) abort();
+
+    size_t count;
+    while (fwCacheCount < FW_CACHE_ENTRIES &&
+           (count = fread(records, sizeof(odroid_fw_index_t), chunk, fwIndexFile)) > 0)
+    {
+        for (int i = 0; i < count && fwCacheCount < FW_CACHE_ENTRIES; ++i)
+        {
+            odroid_fw_index_t *record = &records[i];
+            odroid_fw_summary_t *entry = &fwCache[fwCacheCount++];
+
+            // Holes left by files that couldn't be indexed never match a path
+            record->path[FW_INDEX_PATH_SIZE - 1] = 0;
+            record->description[FIRMWARE_DESCRIPTION_SIZE - 1] = 0;
+
+            entry->path = strdup(record->path);
+            if (!entry->path) abort();
+
+            entry->hash = firmware_cache_hash(record->path);
+            entry->fileSize = record->fileSize;
+            entry->mtime = record->mtime;
+            entry->flashSize = record->flashSize;
+            entry->checksum = record->checksum;
+            memcpy(entry->description, record->description, FIRMWARE_DESCRIPTION_SIZE);
+            entry->valid = record->valid;
+            entry->indexed = (record->path[0] != 0);
+            entry->tile = -1;
+            entry->lastUse = 0;
+            entry->session = 0;
+        }
+    }
+
+    free(records);
+
+    ESP_LOGI(__func__, "Loaded %d index records from %s", fwCacheCount, path);
+}
+
+static void firmware_index_close()
+{
+    if (fwIndexFile) fclose(fwIndexFile);
+    if (fwIndexTiles) fclose(fwIndexTiles);
+
+    fwIndexFile = NULL;
+    fwIndexTiles = NULL;
+}
+
+// Gives entry a tile slot, taking it from the least recently used holder if needed
+static uint16_t* firmware_cache_tile(odroid_fw_summary_t *entry)
+{
+    if (entry->tile < 0)
+    {
+        int slot = 0;
+
+        for (int i = 0; i < FW_CACHE_TILES; ++i)
+        {
+            if (fwCacheTileOwner[i] < 0)
+            {
+                slot = i;
+                break;
+            }
+
+            if (fwCache[fwCacheTileOwner[i]].lastUse < fwCache[fwCacheTileOwner[slot]].lastUse) slot = i;
+        }
+
+        if (fwCacheTileOwner[slot] >= 0)
+            fwCache[fwCacheTileOwner[slot]].tile = -1;
+
+        fwCacheTileOwner[slot] = entry - fwCache;
+        entry->tile = slot;
+    }
+
+    return &fwCacheTiles[entry->tile * FIRMWARE_TILE_SIZE];
+}
+
+static void firmware_tile_placeholder(uint16_t *tile)
+{
+    for (int i = 0; i < FIRMWARE_TILE_SIZE; ++i)
+        tile[i] = FW_TILE_PLACEHOLDER;
+}
+
+static odroid_fw_summary_t* firmware_cache_find(const char* path, uint32_t hash)
+{
+    for (int i = 0; i < fwCacheCount; ++i)
+    {
+        if (fwCache[i].hash == hash && strcmp(fwCache[i].path, path) == 0)
+            return &fwCache[i];
+    }
+
+    return NULL;
+}
+
+// Loader side of the cache: brings path up to date, its tile too if asked. The loader
+// is the only task changing the cache, so it reads it freely and only takes fwCacheLock
+// to change it, never while waiting for the SD card. Returns true if anything changed.
+static bool firmware_cache_load(const char* path, bool withTile)
+{
+    uint32_t hash = firmware_cache_hash(path);
+    odroid_fw_summary_t *entry = firmware_cache_find(path, hash);
+    struct stat st;
+
+    // Files are parsed once, then compared by size and mtime once per browser session
+    if (!entry || entry->session != fwCacheSession)
+    {
+        if (stat(path, &st) != 0)
+        {
+            st.st_size = 0;
+            st.st_mtime = 0;
+        }
+
+        bool changed = !entry || entry->fileSize != st.st_size || entry->mtime != st.st_mtime;
+
+        // Missing from the index, e.g. one made since the entry was cached
+        bool unindexed = entry && !entry->indexed && fwIndexFile && strlen(path) < FW_INDEX_PATH_SIZE;
+
+        // The record needs the tile, parse the file again if it was dropped
+        if (changed || (unindexed && entry->tile < 0))
+        {
+            bool valid = firmware_get_info(path, fwLoaderBuffer);
+
+            xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+
+            if (!entry) entry = firmware_cache_add(path, hash);
+
+            entry->fileSize = st.st_size;
+            entry->mtime = st.st_mtime;
+            entry->valid = valid;
+            entry->flashSize = valid ? fwLoaderBuffer->flashSize : 0;
+            entry->checksum = valid ? fwLoaderBuffer->checksum : 0;
+            entry->lastUse = ++fwCacheClock;
+
+            // A file that didn't parse may have left the header of the previous one
+            if (valid)
+            {
+                strncpy(entry->description, fwLoaderBuffer->fileHeader.description, FIRMWARE_DESCRIPTION_SIZE - 1);
+                entry->description[FIRMWARE_DESCRIPTION_SIZE - 1] = 0;
+                memcpy(firmware_cache_tile(entry), fwLoaderBuffer->fileHeader.tile, FIRMWARE_TILE_SIZE * sizeof(uint16_t));
+            }
+            else
+            {
+                entry->description[0] = 0;
+                firmware_tile_placeholder(firmware_cache_tile(entry));
+            }
+
+            xSemaphoreGive(fwCacheLock);
+
+            firmware_index_write(entry);
+            ESP_LOGD(__func__, "Parsed %s", path);
+        }
+        else if (unindexed)
+        {
+            firmware_index_write(entry);
+        }
+
+        xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+        entry->session = fwCacheSession;
+        xSemaphoreGive(fwCacheLock);
+        return true;
+    }
+
+    // Only the tile was dropped. The index has it, otherwise it sits right after the
+    // header and description of the file.
+    if (withTile && entry->tile < 0)
+    {
+        uint16_t *dst = fwLoaderBuffer->fileHeader.tile;
+        size_t tileSize = FIRMWARE_TILE_SIZE * sizeof(uint16_t);
+        bool read = false;
+
+        if (entry->indexed && fwIndexTiles)
+        {
+            read = fseek(fwIndexTiles, (entry - fwCache) * tileSize, SEEK_SET) == 0 &&
+                   fread(dst, tileSize, 1, fwIndexTiles) == 1;
+        }
+
+        if (!read)
+        {
+            FILE* file = fopen(path, "rb");
+
+            read = file && fseek(file, FIRMWARE_HEADER_SIZE + FIRMWARE_DESCRIPTION_SIZE, SEEK_SET) == 0 &&
+                   fread(dst, tileSize, 1, file) == 1;
+
+            if (file) fclose(file);
+        }
+
+        if (!read) firmware_tile_placeholder(dst);
+
+        xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+        entry->lastUse = ++fwCacheClock;
+        memcpy(firmware_cache_tile(entry), dst, tileSize);
+        xSemaphoreGive(fwCacheLock);
+        return true;
+    }
+
+    return false;
+}
+
+// UI side of the cache: copies what is known about path without waiting for the SD card.
+// An entry from the index is returned before the loader checked it, see FW_PEEK_CURRENT.
+static int firmware_cache_peek(const char* path, odroid_fw_summary_t *summary, uint16_t *tile)
+{
+    size_t tileSize = FIRMWARE_TILE_SIZE * sizeof(uint16_t);
+    int found = 0;
+
+    // Without the cache, or for a path too long for the loader, read the file here
+    if (!fwCache || strlen(path) >= FW_LOADER_PATH_SIZE)
+    {
+        summary->valid = firmware_get_info(path, fwInfoBuffer);
+        summary->flashSize = summary->valid ? fwInfoBuffer->flashSize : 0;
+
+        if (summary->valid)
+            memcpy(tile, fwInfoBuffer->fileHeader.tile, tileSize);
+        else
+            firmware_tile_placeholder(tile);
+
+        return FW_PEEK_SUMMARY | FW_PEEK_CURRENT | FW_PEEK_TILE;
+    }
+
+    xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+
+    odroid_fw_summary_t *entry = firmware_cache_find(path, firmware_cache_hash(path));
+    if (entry)
+    {
+        *summary = *entry;
+        entry->lastUse = ++fwCacheClock;
+        found |= FW_PEEK_SUMMARY;
+
+        if (entry->session == fwCacheSession)
+            found |= FW_PEEK_CURRENT;
+
+        if (entry->tile >= 0)
+        {
+            memcpy(tile, &fwCacheTiles[entry->tile * FIRMWARE_TILE_SIZE], tileSize);
+            found |= FW_PEEK_TILE;
+        }
+    }
+
+    xSemaphoreGive(fwCacheLock);
+    return found;
+}
+
+// Loads the files of the current page: all descriptions first, then the tiles. The
+// pages either side are prefetched the same way afterwards. The page can change under
+// it, it then drops what it was doing after the current file and starts over.
+static void firmware_loader_task(void *arg)
+{
+    char path[FW_LOADER_PATH_SIZE];
+    uint32_t generation = 0;
+
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        int pass = 0;
+        int next = 0;
+
+        while (true)
+        {
+            xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+
+            if (generation != fwLoaderGeneration)
+            {
+                generation = fwLoaderGeneration;
+                pass = 0;
+                next = 0;
+            }
+
+            // Passes 0 and 1 are the page, 2 and 3 the prefetch. Odd ones load tiles.
+            int first = (pass < 2) ? 0 : fwLoaderPageCount;
+            int end = (pass < 2) ? fwLoaderPageCount : fwLoaderWantedCount;
+
+            if (next < first) next = first;
+
+            if (next >= end)
+            {
+                xSemaphoreGive(fwCacheLock);
+
+                if (++pass > 3) break;
+
+                next = 0;
+                continue;
+            }
+
+            strcpy(path, fwLoaderWanted[next++]);
+            xSemaphoreGive(fwCacheLock);
+
+            if (firmware_cache_load(path, pass & 1))
+                fwLoaderProgress++;
+        }
+
+        xSemaphoreGive(fwLoaderIdle);
+    }
+
+    vTaskDelete(NULL);
+}
+
+static bool firmware_loader_add(char* file, int *count)
+{
+    char path[FW_LOADER_PATH_SIZE];
+
+    // Left out rather than truncated, firmware_cache_peek reads those itself
+    if (snprintf(path, sizeof(path), "%s/%s", FIRMWARE_PATH, file) >= (int)sizeof(path))
+        return false;
+
+    char *wanted = fwLoaderWanted[(*count)++];
+    if (strcmp(path, wanted) == 0) return false;
+
+    strcpy(wanted, path);
+    return true;
+}
+
+// Hands the page starting at files[page] to the loader, and the pages a LEFT or RIGHT
+// would flip to for prefetching. Those wrap around, see ui_choose_file.
+static void firmware_loader_want(char** files, int fileCount, int page)
+{
+    int lastPage = (fileCount - 1) / ITEM_COUNT * ITEM_COUNT;
+    int nextPage = (page + ITEM_COUNT <= lastPage) ? page + ITEM_COUNT : 0;
+    int previousPage = (page - ITEM_COUNT >= 0) ? page - ITEM_COUNT : lastPage;
+    int count = 0;
+
+    if (!fwLoaderTask) return;
+
+    xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+
+    bool changed = false;
+    for (int i = page; i < page + ITEM_COUNT && i < fileCount; ++i)
+        changed |= firmware_loader_add(files[i], &count);
+
+    changed |= (count != fwLoaderPageCount);
+    fwLoaderPageCount = count;
+
+    if (nextPage != page)
+    {
+        for (int i = nextPage; i < nextPage + ITEM_COUNT && i < fileCount; ++i)
+            changed |= firmware_loader_add(files[i], &count);
+    }
+
+    if (previousPage != page && previousPage != nextPage)
+    {
+        for (int i = previousPage; i < previousPage + ITEM_COUNT && i < fileCount; ++i)
+            changed |= firmware_loader_add(files[i], &count);
+    }
+
+    changed |= (count != fwLoaderWantedCount);
+    fwLoaderWantedCount = count;
+    if (changed) fwLoaderGeneration++;
+
+    xSemaphoreGive(fwCacheLock);
+
+    xTaskNotifyGive(fwLoaderTask);
+}
+
+// Returns once the loader let go of the cache and the index
+static void firmware_loader_stop()
+{
+    if (!fwLoaderTask) return;
+
+    xSemaphoreTake(fwCacheLock, portMAX_DELAY);
+    fwLoaderWantedCount = 0;
+    fwLoaderPageCount = 0;
+    fwLoaderGeneration++;
+    xSemaphoreGive(fwCacheLock);
+
+    xSemaphoreTake(fwLoaderIdle, 0);
+    xTaskNotifyGive(fwLoaderTask);
+    xSemaphoreTake(fwLoaderIdle, portMAX_DELAY);
+}
+
+void flash_utility()
+{
+    // Code to flash utility.bin.
+    // Because leaving it in flash_firmware results in multiple copies being flashed.
+    //FILE* util = fopen("/sd/odroid/utility.bin", "rb");
+    //util_part.type = ESP_PARTITION_TYPE_APP;
+    //util_part.subtype = ESP_PARTITION_SUBTYPE_APP_TEST;
+}
+
+
+void flash_firmware(const char* fullPath)
+{
+    ESP_LOGD(__func__, "HEAP=%#010x", esp_get_free_heap_size());
+    LED_OFF();
+
+    size_t count;
+    bool can_proceed = true;
+
+    sort_app_table(APP_SORT_OFFSET);
+
+    ui_draw_title("Install Application", "Destination: Pending");
+    UpdateDisplay();
+
+    ESP_LOGI(__func__, "Flashing file: %s", fullPath);
+
+    FILE* file = fopen(fullPath, "rb");
+    if (file == NULL)
+    {
+        DisplayError("FILE OPEN ERROR");
+        indicate_error();
+    }
+
+    odroid_fw_t *fw = fwInfoBuffer;
+
+    if (!firmware_get_info(fullPath, fw))
+    {
+        // To do: Make it show what is invalid
+        DisplayError("INVALID FIRMWARE FILE");
+        can_proceed = false;
+    }
+
+    int currentFlashAddress = find_free_block(fw->flashSize, true);
 
     odroid_app_t *app = &apps[apps_count];
     memset(app, 0x00, sizeof(odroid_app_t));
@@ -1112,20 +2222,59 @@ static void ui_draw_title(char* TITLE, char* FOOTER)
 }
 
 
+static void ui_draw_battery();
+
 static void ui_draw_indicators(int page, int totalPages)
 {
     UG_FontSelect(&FONT_8X8);
-    UG_SetForecolor(0x8C51);
+    UG_SetForecolor(UG_RGB565(0x8C51));
 
     // Page indicator
     sprintf(tempstring, "%d/%d", page, totalPages);
     UG_PutString(4, 4, tempstring);
 
-    // Battery indicator
+    ui_draw_battery();
+}
+
+// Battery indicator, on its own so it can be refreshed without the page
+static void ui_draw_battery()
+{
+    // Room for "100%"
+    UG_FillFrame(320 - (9 * 4) - 4, 4, 319 - 4, 4 + 8 - 1, C_MIDNIGHT_BLUE);
+
+    UG_FontSelect(&FONT_8X8);
+    UG_SetForecolor(UG_RGB565(0x8C51));
+    UG_SetBackcolor(C_MIDNIGHT_BLUE);
+
+    batteryChanged = false;
     sprintf(tempstring, "%d%%", batteryPercent);
     UG_PutString(320 - (9 * strlen(tempstring)) - 4, 4, tempstring);
 }
 
+// wait_for_button_press for the browsers, redrawing the battery indicator whenever
+// battery_task reports a change. Nothing else happens while idle. buttons carries
+// the gamepad state from one call to the next, see wait_for_button_press_from.
+static int ui_wait_for_button(odroid_gamepad_state *buttons, int ticks)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    while (true)
+    {
+        int btn = wait_for_button_press_from(buttons, (ticks > 0 && ticks < UI_IDLE_TICKS) ? ticks : UI_IDLE_TICKS);
+        if (btn >= 0)
+            return btn;
+
+        if (batteryChanged)
+        {
+            ui_draw_battery();
+            UpdateDisplay();
+        }
+
+        if (ticks > 0 && xTaskGetTickCount() - start >= ticks)
+            return -1;
+    }
+}
+
 
 static void ui_draw_row(int line, char *line1, char* line2, uint16_t color, uint16_t *tile, bool selected)
 {
@@ -1146,7 +2295,11 @@ static void ui_draw_row(int line, char *line1, char* line2, uint16_t color, uint
     UG_SetBackcolor(selected ? C_YELLOW : C_WHITE);
     UG_FillFrame(0, top + 2, 319, top + itemHeight - 1 - 1, UG_GetBackcolor());
 
-    ui_draw_image(imageLeft, top + 2, TILE_WIDTH, TILE_HEIGHT, tile);
+    // No tile yet, the row is drawn again once the loader has it
+    if (tile)
+        ui_draw_image(imageLeft, top + 2, TILE_WIDTH, TILE_HEIGHT, tile);
+    else
+        UG_FillFrame(imageLeft, top + 2, imageLeft + TILE_WIDTH - 1, top + 2 + TILE_HEIGHT - 1, C_LIGHT_GRAY);
 
     UG_SetForecolor(C_BLACK);
     UG_PutString(textLeft, top + 2 + 2 + 7, line1);
@@ -1156,7 +2309,52 @@ static void ui_draw_row(int line, char *line1, char* line2, uint16_t color, uint
 }
 
 
-static void ui_draw_page(char** files, int fileCount, int currentItem)
+// Draws rows first to last of the current page only. Returns a bit per row drawn
+// before the loader had all of its file.
+static int ui_draw_file_rows(char** files, int fileCount, int currentItem, int first, int last)
+{
+    int page = (currentItem / ITEM_COUNT) * ITEM_COUNT;
+
+    char line1[64], line2[64];
+    uint16_t color = C_GRAY;
+    int pendingRows = 0;
+
+    for (int line = first; line <= last && (page + line) < fileCount; ++line)
+    {
+        char* fileName = files[page + line];
+        if (!fileName) abort();
+
+        sprintf(tempstring, "%s/%s", FIRMWARE_PATH, fileName);
+
+        odroid_fw_summary_t fw;
+        int found = firmware_cache_peek(tempstring, &fw, tileBuffer);
+
+        if ((found & (FW_PEEK_CURRENT | FW_PEEK_TILE)) != (FW_PEEK_CURRENT | FW_PEEK_TILE))
+            pendingRows |= (1 << line);
+
+        strcpy(line1, fileName);
+        line1[strlen(fileName) - 3] = 0; // ".fw" = 3
+
+        if (!(found & FW_PEEK_SUMMARY)) {
+            color = C_GRAY;
+            sprintf(line2, "Loading...");
+        } else if (fw.valid) {
+            color = C_GRAY;
+            sprintf(line2, "%.2f MB", (float)fw.flashSize / 1024 / 1024);
+        } else {
+            color = C_RED;
+            sprintf(line2, "Invalid firmware");
+        }
+
+        ui_draw_row(line, line1, line2, color, (found & FW_PEEK_TILE) ? tileBuffer : NULL,
+                    (page + line) == currentItem);
+    }
+
+    return pendingRows;
+}
+
+// Returns a bit per row drawn before the loader had all of its file
+static int ui_draw_page(char** files, int fileCount, int currentItem)
 {
     int page = (currentItem / ITEM_COUNT) * ITEM_COUNT;
 
@@ -1174,36 +2372,42 @@ static void ui_draw_page(char** files, int fileCount, int currentItem)
 	if (fileCount < 1)
 	{
         DisplayMessage("SD Card Empty");
-        return;
+        return 0;
 	}
 
-    char line1[64], line2[64];
-    uint16_t color = C_GRAY;
+    int pendingRows = ui_draw_file_rows(files, fileCount, currentItem, 0, ITEM_COUNT - 1);
 
-    for (int line = 0; line < ITEM_COUNT && (page + line) < fileCount; ++line)
-    {
-        char* fileName = files[page + line];
-        if (!fileName) abort();
+    firmware_loader_want(files, fileCount, page);
 
-        sprintf(tempstring, "%s/%s", FIRMWARE_PATH, fileName);
-        bool valid = firmware_get_info(tempstring, fwInfoBuffer);
+    UpdateDisplay();
+    return pendingRows;
+}
 
-        strcpy(line1, fileName);
-        line1[strlen(fileName) - 3] = 0; // ".fw" = 3
+// Redraws rows first to last and nothing else of the page, the title and free
+// space stay as ui_draw_page left them. Returns pendingRows with their bits updated.
+static int ui_draw_rows(char** files, int fileCount, int currentItem, int first, int last, int pendingRows)
+{
+    int rows = ((1 << (last + 1)) - 1) & ~((1 << first) - 1);
 
-        if (valid) {
-            color = C_GRAY;
-            sprintf(line2, "%.2f MB", (float)fwInfoBuffer->flashSize / 1024 / 1024);
-        } else {
-            color = C_RED;
-            sprintf(line2, "Invalid firmware");
-        }
+    pendingRows = (pendingRows & ~rows) | ui_draw_file_rows(files, fileCount, currentItem, first, last);
 
-        ui_draw_row(line, line1, line2, color,
-                        fwInfoBuffer->fileHeader.tile, (page + line) == currentItem);
-    }
+    UpdateDisplay();
+    return pendingRows;
+}
+
+// Redraws the rows of the old and new selection, both on the same page. Rows
+// between them (a wrap from the last row to the first) are left alone.
+static int ui_draw_selection(char** files, int fileCount, int previousItem, int currentItem, int pendingRows)
+{
+    int previousRow = previousItem % ITEM_COUNT;
+    int currentRow = currentItem % ITEM_COUNT;
+
+    pendingRows &= ~((1 << previousRow) | (1 << currentRow));
+    pendingRows |= ui_draw_file_rows(files, fileCount, currentItem, previousRow, previousRow);
+    pendingRows |= ui_draw_file_rows(files, fileCount, currentItem, currentRow, currentRow);
 
     UpdateDisplay();
+    return pendingRows;
 }
 
 char* ui_choose_file(const char* path)
@@ -1225,17 +2429,48 @@ char* ui_choose_file(const char* path)
     int fileCount = odroid_sdcard_files_get(path, ".fw", &files);
     ESP_LOGI(__func__, "fileCount=%d", fileCount);
 
+    // Files may have been replaced since the last time, check them again
+    fwCacheSession++;
+    firmware_index_open(path);
+
     // Selection
     int currentItem = 0;
+    int drawnItem = -1;
+    int pendingRows = 0;
+
+    // Only ui_wait_for_button reads the gamepad from here on, so presses made
+    // while rows are being redrawn are still seen
+    odroid_gamepad_state buttons;
+    input_read(&buttons);
 
     while (true)
     {
-        ui_draw_page(files, fileCount, currentItem);
+        int progress = fwLoaderProgress;
+
+        if (drawnItem >= 0 && drawnItem != currentItem && drawnItem / ITEM_COUNT == currentItem / ITEM_COUNT)
+            pendingRows = ui_draw_selection(files, fileCount, drawnItem, currentItem, pendingRows);
+        else
+            pendingRows = ui_draw_page(files, fileCount, currentItem);
+
+        drawnItem = currentItem;
 
         int page = (currentItem / ITEM_COUNT) * ITEM_COUNT;
 
-        // Wait for input but refresh display after 1000 ticks if no input
-        int btn = wait_for_button_press(1000);
+        // Wait for input. Rows drawn before their file was loaded are drawn again as
+        // the loader gets to them.
+        int btn = ui_wait_for_button(&buttons, pendingRows ? FW_LOADER_POLL_TICKS : -1);
+
+        while (btn < 0 && pendingRows)
+        {
+            if (progress != fwLoaderProgress)
+            {
+                progress = fwLoaderProgress;
+                pendingRows = ui_draw_rows(files, fileCount, currentItem,
+                                           __builtin_ctz(pendingRows), 31 - __builtin_clz(pendingRows), pendingRows);
+            }
+
+            btn = ui_wait_for_button(&buttons, pendingRows ? FW_LOADER_POLL_TICKS : -1);
+        }
 
         if (fileCount > 0)
         {
@@ -1279,6 +2514,8 @@ char* ui_choose_file(const char* path)
         }
     }
 
+    firmware_loader_stop();
+    firmware_index_close();
     odroid_sdcard_files_free(files, fileCount);
 
     return result;
@@ -1403,12 +2640,17 @@ void ui_choose_app()
 
     while (true)
     {
+        // Dialogs wait for buttons on their own, so start from the current state,
+        // read before drawing so presses made meanwhile are seen
+        odroid_gamepad_state buttons;
+        input_read(&buttons);
+
         ui_draw_app_page(currentItem);
 
         int page = (currentItem / ITEM_COUNT) * ITEM_COUNT;
 
-        // Wait for input but refresh display after 1000 ticks if no input
-        int btn = (queuedBtn != -1) ? queuedBtn : wait_for_button_press(1000);
+        // Wait for input, nothing but the battery indicator is redrawn until then
+        int btn = (queuedBtn != -1) ? queuedBtn : ui_wait_for_button(&buttons, -1);
         queuedBtn = -1;
 
 		if (apps_count > 0)
@@ -1577,21 +2819,25 @@ void app_main(void)
     ili9341_init();
     ili9341_clear(0xffff);
 
-    UG_Init(&gui, pset, 320, 240);
+    // The pages are mostly overlapping fills, sending each of them costs more than the screen
+    ui_init(UI_PRESENT_RUNS);
 
     // Start battery monitor
     xTaskCreate(&battery_task, "battery_task", 4096, NULL, 5, NULL);
 
     fwInfoBuffer = malloc(sizeof(odroid_fw_t));
     dataBuffer = malloc(FLASH_BLOCK_SIZE);
+    tileBuffer = malloc(FIRMWARE_TILE_SIZE * sizeof(uint16_t));
 
     // If we can't allocate our basic buffers we might as well give up now
-    if (!fwInfoBuffer || !dataBuffer)
+    if (!fwInfoBuffer || !dataBuffer || !tileBuffer)
     {
         DisplayError("MEMORY ALLOCATION ERROR");
         indicate_error();
     }
 
+    firmware_cache_init();
+
     read_partition_table();
     read_app_table();
 
@@ -2,6 +2,7 @@
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/spi_master.h"
 #include "driver/ledc.h"
 #include "driver/rtc_io.h"
@@ -36,14 +37,38 @@ const int LCD_SPI_CLOCK_RATE = 40000000;
 #define TFT_RGB_BGR 0x08
 
 
+#define LINE_BUFFERS (3)
+#define LINE_COUNT (4)
+#define LINE_SIZE (320 * LINE_COUNT) // Pixels per line buffer, must be at least 320
+
+#define DATA_TRANS_COUNT (7)                // Matches devcfg.queue_size
+#define MAX_TRANSFER_SIZE (320 * 2 * 24)    // Bytes per DMA transaction, must fit buscfg.max_transfer_sz
+
+// #define STATS_LOG_INTERVAL (5000 * 1000) // Log the transport counters every 5s (in us)
+
+// Bits carried in spi_transaction_t.user
+#define TRANS_DC_DATA (1 << 0)
+#define TRANS_NOTIFY  (1 << 1)
+
+
 static spi_transaction_t trans[8];
+static spi_transaction_t data_trans[DATA_TRANS_COUNT];
+static int data_trans_next = 0;
 static spi_device_handle_t spi;
-//static volatile short freeTransactionCount = 6;
+static int pending_trans = 0;
+static int window_left = -1, window_right = -1; // Last CASET range sent
+static volatile bool frame_pending = false;
 static TaskHandle_t xTaskToNotify = NULL;
-//static bool useCallbacks = false;
+static ili9341_stats_t stats;
+static int64_t present_start = 0;
+#ifdef STATS_LOG_INTERVAL
+static int64_t stats_logged = 0;
+#endif
 
 
-static uint16_t line[2][320]; // Must be at least 320
+// LINE_BUFFERS line buffers of LINE_SIZE pixels, one flat block so fills can use all of it
+static uint16_t lineBuffers[LINE_BUFFERS * LINE_SIZE];
+#define LINE_BUFFER(n) (&lineBuffers[(n) * LINE_SIZE])
 
 const int DUTY_MAX = 0x1fff;
 
@@ -145,13 +170,15 @@ static void ili_data(spi_device_handle_t spi, const uint8_t *data, int len)
 //set the D/C line to the value indicated in the user field.
 static void ili_spi_pre_transfer_callback(spi_transaction_t *t)
 {
-    int dc=(int)t->user;
+    int dc=(int)t->user & TRANS_DC_DATA;
     gpio_set_level(LCD_PIN_NUM_DC, dc);
 }
 
+//This function is called (in irq context!) when a transmission ends. The last transaction
+//of an asynchronous frame carries TRANS_NOTIFY to wake up whoever waits for the frame.
 static void ili_spi_post_transfer_callback(spi_transaction_t *t)
 {
-    if(xTaskToNotify && t == &trans[7])
+    if(xTaskToNotify && ((int)t->user & TRANS_NOTIFY))
     {
         BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
@@ -185,40 +212,136 @@ static void ili_init()
     }
 }
 
+static void ili_queue_trans(spi_transaction_t *t)
+{
+    esp_err_t ret=spi_device_queue_trans(spi, t, 1000 / portTICK_RATE_MS);
+    assert(ret==ESP_OK);
+    pending_trans++;
+
+    stats.transactions++;
+    stats.bytes += t->length / 8;
+}
+
+//Reclaim the oldest `count` queued transactions. Results are returned in queue order.
+static void ili_wait_trans(int count)
+{
+    esp_err_t ret;
+    spi_transaction_t *rtrans;
+
+    if (count <= 0 || pending_trans <= 0) return;
+
+    int64_t start = esp_timer_get_time();
+
+    while (count-- > 0 && pending_trans > 0) {
+        ret=spi_device_get_trans_result(spi, &rtrans, portMAX_DELAY);
+        assert(ret==ESP_OK);
+        pending_trans--;
+    }
+
+    stats.waitTime += esp_timer_get_time() - start;
+}
+
+void ili9341_wait_frame()
+{
+    // Only the task that queued the frame is notified, anyone else just drains the queue
+    if (frame_pending && xTaskToNotify == xTaskGetCurrentTaskHandle())
+    {
+        int64_t start = esp_timer_get_time();
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        stats.waitTime += esp_timer_get_time() - start;
+    }
+
+    frame_pending = false;
+    ili_wait_trans(pending_trans);
+}
+
+void ili9341_begin_present()
+{
+    present_start = esp_timer_get_time();
+}
+
+void ili9341_end_present()
+{
+    ili9341_wait_frame();
+
+    int64_t now = esp_timer_get_time();
+    uint32_t elapsed = now - present_start;
+
+    stats.presents++;
+    stats.presentTime += elapsed;
+    if (elapsed > stats.presentTimeMax)
+        stats.presentTimeMax = elapsed;
+
+#ifdef STATS_LOG_INTERVAL
+    if (now - stats_logged >= STATS_LOG_INTERVAL)
+    {
+        ESP_LOGI(__func__, "%u presents, %u bytes, %u transactions, waited %u ms, avg %u us, max %u us",
+            stats.presents, stats.bytes, stats.transactions, (uint32_t)(stats.waitTime / 1000),
+            (uint32_t)(stats.presentTime / stats.presents), stats.presentTimeMax);
+        stats_logged = now;
+    }
+#endif
+}
+
+void ili9341_get_stats(ili9341_stats_t *out, bool reset)
+{
+    *out = stats;
+
+    if (reset)
+        memset(&stats, 0, sizeof(stats));
+}
+
 static void send_reset_drawing(int left, int top, int width, int height)
 {
-  esp_err_t ret;
+  int right = left + width - 1;
+  int first = 0;
+
+  // Anything still in flight must be done before we move the window
+  ili9341_wait_frame();
+
+  // The command bytes are set once in ili9341_init, only the parameters change.
+  // CASET can be skipped entirely when the column range didn't change.
+  if (left == window_left && right == window_right)
+  {
+      first = 2;
+  }
+  else
+  {
+      trans[1].tx_data[0]=(left) >> 8;              //Start Col High
+      trans[1].tx_data[1]=(left) & 0xff;              //Start Col Low
+      trans[1].tx_data[2]=(right) >> 8;       //End Col High
+      trans[1].tx_data[3]=(right) & 0xff;     //End Col Low
+      window_left = left;
+      window_right = right;
+  }
 
-  trans[0].tx_data[0]=0x2A;           //Column Address Set
-  trans[1].tx_data[0]=(left) >> 8;              //Start Col High
-  trans[1].tx_data[1]=(left) & 0xff;              //Start Col Low
-  trans[1].tx_data[2]=(left + width - 1) >> 8;       //End Col High
-  trans[1].tx_data[3]=(left + width - 1) & 0xff;     //End Col Low
-  trans[2].tx_data[0]=0x2B;           //Page address set
   trans[3].tx_data[0]=top >> 8;        //Start page high
   trans[3].tx_data[1]=top & 0xff;      //start page low
   trans[3].tx_data[2]=(top + height - 1)>>8;    //end page high
   trans[3].tx_data[3]=(top + height - 1)&0xff;  //end page low
-  trans[4].tx_data[0]=0x2C;           //memory write
 
-  // Queue all transactions.
-  for (int x = 0; x < 5; x++) {
-      ret=spi_device_queue_trans(spi, &trans[x], 1000 / portTICK_RATE_MS);
+#ifdef HAVE_SPI_POLLING_TRANSMIT
+  // These are tiny, busy waiting is much cheaper than an interrupt and a queue round trip each
+  esp_err_t ret;
+  for (int x = first; x < 5; x++) {
+      ret=spi_device_polling_transmit(spi, &trans[x]);
       assert(ret==ESP_OK);
+      stats.transactions++;
+      stats.bytes += trans[x].length / 8;
+  }
+#else
+  // Queue all transactions.
+  for (int x = first; x < 5; x++) {
+      ili_queue_trans(&trans[x]);
   }
 
   // Wait for all transactions
-  spi_transaction_t *rtrans;
-  for (int x = 0; x < 5; x++) {
-      ret=spi_device_get_trans_result(spi, &rtrans, 1000 / portTICK_RATE_MS);
-      assert(ret==ESP_OK);
-  }
+  ili_wait_trans(5 - first);
+#endif
 }
 
 static void send_continue_line(uint16_t *line, int width, int lineCount)
 {
-  esp_err_t ret;
-
   trans[6].tx_data[0] = 0x3C;           //memory write continue
   trans[6].length = 8;            //Data length, in bits
   trans[6].flags = SPI_TRANS_USE_TXDATA;
@@ -231,16 +354,38 @@ static void send_continue_line(uint16_t *line, int width, int lineCount)
 
   //Queue all transactions.
   for (int x = 6; x < 8; x++) {
-      ret=spi_device_queue_trans(spi, &trans[x], 1000 / portTICK_RATE_MS);
-      assert(ret==ESP_OK);
+      ili_queue_trans(&trans[x]);
   }
 
   // Wait for all transactions
-  spi_transaction_t *rtrans;
-  for (int x = 0; x < 2; x++) {
-      ret=spi_device_get_trans_result(spi, &rtrans, portMAX_DELAY);
-      assert(ret==ESP_OK);
+  ili_wait_trans(2);
+}
+
+//Queue pixel data after RAMWR without waiting for it. The buffer must stay untouched until
+//the transaction completes. The last chunk of a frame notifies the calling task from the
+//post-transfer callback.
+static void send_data_async(const uint16_t *data, int pixelCount, bool lastChunk)
+{
+  // The queue is full, reclaim the oldest descriptor
+  if (pending_trans >= DATA_TRANS_COUNT)
+  {
+      ili_wait_trans(1);
   }
+
+  spi_transaction_t *t = &data_trans[data_trans_next];
+  data_trans_next = (data_trans_next + 1) % DATA_TRANS_COUNT;
+
+  t->tx_buffer = data;
+  t->length = pixelCount * 2 * 8;
+  t->user = (void*)(TRANS_DC_DATA | (lastChunk ? TRANS_NOTIFY : 0));
+
+  if (lastChunk)
+  {
+      xTaskToNotify = xTaskGetCurrentTaskHandle();
+      frame_pending = true;
+  }
+
+  ili_queue_trans(t);
 }
 
 static void backlight_init()
@@ -305,16 +450,7 @@ void ili9341_write_frame(uint16_t* buffer)
 {
     if (buffer == NULL)
     {
-        // clear the buffer
-        memset(line[0], 0x00, 320 * sizeof(uint16_t));
-
-        // clear the screen
-        send_reset_drawing(0, 0, 320, 240);
-
-        for (int y = 0; y < 240; ++y)
-        {
-            send_continue_line(line[0], 320, 1);
-        }
+        ili9341_fill_rect(0, 0, 320, 240, 0x0000);
     }
     else
     {
@@ -336,26 +472,19 @@ void ili9341_write_frame_rectangle(short left, short top, short width, short hei
     if (left < 0 || top < 0) abort();
     if (width < 1 || height < 1) abort();
 
-    send_reset_drawing(left, top, width, height);
-
     if (buffer == NULL)
     {
-        // clear the buffer
-        memset(line[0], 0x00, 320 * sizeof(uint16_t));
-
-        // clear the screen
-        for (int y = 0; y < height; ++y)
-        {
-            send_continue_line(line[0], width, 1);
-        }
+        ili9341_fill_rect(left, top, width, height, 0x0000);
     }
     else
     {
+        send_reset_drawing(left, top, width, height);
+
         short alt = 0;
         for (int y = 0; y < height; y++)
         {
-            memcpy(line[alt], buffer + y * width, width * sizeof(uint16_t));
-            send_continue_line(line[alt], width, 1);
+            memcpy(LINE_BUFFER(alt), buffer + y * width, width * sizeof(uint16_t));
+            send_continue_line(LINE_BUFFER(alt), width, 1);
 
             ++alt;
             if (alt > 1) alt = 0;
@@ -365,61 +494,130 @@ void ili9341_write_frame_rectangle(short left, short top, short width, short hei
 
 void ili9341_clear(uint16_t color)
 {
-    send_reset_drawing(0, 0, 320, 240);
+    ili9341_fill_rect(0, 0, 320, 240, color);
+}
+
+void ili9341_fill_rect(short left, short top, short width, short height, uint16_t color)
+{
+    if (left < 0 || top < 0) abort();
+    if (width < 1 || height < 1) abort();
+
+    send_reset_drawing(left, top, width, height);
+
+    // Use all the line buffers as one big block of color. DMA only reads it so the
+    // same block can be queued as many times as needed, the panel wraps to the next
+    // row of the window on its own.
+    uint16_t *block = lineBuffers;
+    const int blockSize = LINE_BUFFERS * LINE_SIZE;
+    int remaining = width * height;
+    int count = (remaining < blockSize) ? remaining : blockSize;
 
-    // clear the buffer
-    for (int i = 0; i < 320; ++i)
+    for (int i = 0; i < count; ++i)
     {
-        line[0][i] = color;
+        block[i] = color;
     }
 
-    // clear the screen
-    for (int y = 0; y < 240; ++y)
+    while (remaining > 0)
     {
-        send_continue_line(line[0], 320, 1);
+        int pixels = (remaining < blockSize) ? remaining : blockSize;
+        remaining -= pixels;
+
+        send_data_async(block, pixels, remaining == 0);
     }
 }
 
-void ili9341_write_frame_rectangleLE(short left, short top, short width, short height, uint16_t* buffer)
+void ili9341_write_frame_rectangleLE_strided(short left, short top, short width, short height, uint16_t* buffer, short stride)
 {
     if (left < 0 || top < 0) abort();
     if (width < 1 || height < 1) abort();
-
-    send_reset_drawing(left, top, width, height);
+    if (stride < width) abort();
 
     if (buffer == NULL)
     {
-        // clear the buffer
-        memset(line[0], 0x00, 320 * sizeof(uint16_t));
-
-        // clear the screen
-        for (int y = 0; y < height; ++y)
-        {
-            send_continue_line(line[0], width, 1);
-        }
+        ili9341_fill_rect(left, top, width, height, 0x0000);
     }
     else
     {
+        send_reset_drawing(left, top, width, height);
+
+        // Byte swap the next chunk while the previous ones are still on the wire.
+        // The frame keeps streaming after we return, see ili9341_wait_frame().
+        const int linesPerChunk = LINE_SIZE / width;
         short alt = 0;
-        for (int y = 0; y < height; y++)
+
+        for (int y = 0; y < height; y += linesPerChunk)
         {
-            //memcpy(line[alt], buffer + y * width, width * sizeof(uint16_t));
-            for (int i = 0; i < width; ++i)
+            int lines = (height - y < linesPerChunk) ? height - y : linesPerChunk;
+
+            // All buffers are in flight, wait for the oldest one
+            if (pending_trans >= LINE_BUFFERS)
+            {
+                ili_wait_trans(1);
+            }
+
+            uint16_t *dst = LINE_BUFFER(alt);
+            for (int j = 0; j < lines; ++j)
             {
-                uint16_t pixel = buffer[y * width + i];
-                line[alt][i] = pixel << 8 | pixel >> 8;
+                uint16_t *src = buffer + (y + j) * stride;
+                for (int i = 0; i < width; ++i)
+                {
+                    uint16_t pixel = src[i];
+                    *dst++ = pixel << 8 | pixel >> 8;
+                }
             }
 
-            send_continue_line(line[alt], width, 1);
+            send_data_async(LINE_BUFFER(alt), lines * width, y + lines >= height);
 
             ++alt;
-            if (alt > 1) alt = 0;
+            if (alt >= LINE_BUFFERS) alt = 0;
         }
     }
 }
 
+void ili9341_write_frame_rectangle_strided(short left, short top, short width, short height, uint16_t* buffer, short stride)
+{
+    if (left < 0 || top < 0) abort();
+    if (width < 1 || height < 1) abort();
+    if (stride < width) abort();
+
+    if (buffer == NULL)
+    {
+        ili9341_fill_rect(left, top, width, height, 0x0000);
+        return;
+    }
+
+    send_reset_drawing(left, top, width, height);
+
+    // The buffer is already in panel byte order, DMA it in place. Rows should start
+    // on a 32bit boundary or the SPI driver will fall back to a bounce buffer.
+    if (width == stride)
+    {
+        // Rows are contiguous, send the biggest chunks the bus accepts
+        const int linesPerChunk = MAX_TRANSFER_SIZE / (width * 2);
+
+        for (int y = 0; y < height; y += linesPerChunk)
+        {
+            int lines = (height - y < linesPerChunk) ? height - y : linesPerChunk;
+            send_data_async(buffer + y * width, lines * width, y + lines >= height);
+        }
+    }
+    else
+    {
+        for (int y = 0; y < height; y++)
+        {
+            send_data_async(buffer + y * stride, width, y + 1 >= height);
+        }
+    }
+}
+
+void ili9341_write_frame_rectangleLE(short left, short top, short width, short height, uint16_t* buffer)
+{
+    ili9341_write_frame_rectangleLE_strided(left, top, width, height, buffer, width);
+}
+
 void ili9341_deinit()
 {
+    ili9341_wait_frame();
     spi_bus_remove_device(spi);
     backlight_deinit();
     gpio_reset_pin(LCD_PIN_NUM_DC);
@@ -443,6 +641,16 @@ void ili9341_init()
         trans[x].flags=SPI_TRANS_USE_TXDATA;
     }
 
+    trans[0].tx_data[0]=0x2A;           //Column Address Set
+    trans[2].tx_data[0]=0x2B;           //Page address set
+    trans[4].tx_data[0]=0x2C;           //memory write
+    window_left = window_right = -1;
+
+    for (int x=0; x<DATA_TRANS_COUNT; x++) {
+        memset(&data_trans[x], 0, sizeof(spi_transaction_t));
+        data_trans[x].user=(void*)TRANS_DC_DATA;
+    }
+
     // Initialize SPI
     esp_err_t ret;
     //spi_device_handle_t spi;
@@ -454,6 +662,7 @@ void ili9341_init()
     buscfg.sclk_io_num = SPI_PIN_NUM_CLK;
     buscfg.quadwp_io_num=-1;
     buscfg.quadhd_io_num=-1;
+    buscfg.max_transfer_sz = MAX_TRANSFER_SIZE;
 
     spi_device_interface_config_t devcfg;
 	memset(&devcfg, 0, sizeof(devcfg));
@@ -1,11 +1,31 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t bytes;             // Sent over SPI, commands included
+    uint32_t transactions;      // SPI transactions queued
+    uint64_t waitTime;          // us spent blocked waiting for transactions to complete
+    uint32_t presents;          // Completed ili9341_begin_present/ili9341_end_present pairs
+    uint64_t presentTime;       // us from begin to end of all presents
+    uint32_t presentTimeMax;    // us of the slowest present
+} ili9341_stats_t;
+
 void ili9341_init();
 void ili9341_deinit();
 void ili9341_write_frame(uint16_t* buffer);
 void ili9341_write_frame_rectangle(short left, short top, short width, short height, uint16_t* buffer);
+void ili9341_write_frame_rectangle_strided(short left, short top, short width, short height, uint16_t* buffer, short stride);
 void ili9341_write_frame_rectangleLE(short left, short top, short width, short height, uint16_t* buffer);
+void ili9341_write_frame_rectangleLE_strided(short left, short top, short width, short height, uint16_t* buffer, short stride);
+void ili9341_wait_frame();
+void ili9341_begin_present();
+void ili9341_end_present(); // Waits for the frame
+void ili9341_get_stats(ili9341_stats_t *out, bool reset);
 
 void ili9341_clear(uint16_t color);
+void ili9341_fill_rect(short left, short top, short width, short height, uint16_t color); // color is in panel byte order
 
 void backlight_deinit();
\ No newline at end of file
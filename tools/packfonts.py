@@ -0,0 +1,166 @@
+#!/usr/bin/env python
+#
+# Generates components/ugui/ugui_fonts.c and ugui_fonts.h, holding only the fonts
+# referenced by the firmware sources and only the characters we can display.
+# Used when USE_PACKED_FONTS is defined in ugui_config.h. Rerun it whenever a new
+# font gets used:
+#
+#   tools/packfonts.py [--chars 0x20-0x7E] [--rle 16] [--ugui components/ugui] [src_dir ...]
+#
+# Fonts at least --rle pixels tall are also written run length coded
+# (FONT_TYPE_1BPP_RLE), which is used when USE_RLE_FONTS is defined.
+#
+import os, re, glob, argparse
+
+parser = argparse.ArgumentParser(description="Subset the uGUI fonts used by the firmware")
+parser.add_argument("--chars", default="0x20-0x7E",
+                    help="character range to keep, first-last (default: printable ASCII)")
+parser.add_argument("--rle", type=int, default=16,
+                    help="run length code fonts at least this tall, 0 to disable (default: 16)")
+parser.add_argument("--ugui", default="components/ugui", help="uGUI component directory")
+parser.add_argument("sources", nargs="*", default=["main"], help="directories to scan for FONT_ references")
+args = parser.parse_args()
+
+first, last = [int(c, 0) for c in args.chars.split("-")]
+if not 0 <= first <= last <= 255:
+    exit("Invalid character range '%s'" % args.chars)
+
+with open(os.path.join(args.ugui, "ugui.c")) as f:
+    ugui_c = f.read()
+
+# Glyph tables, keyed by their USE_FONT_ name
+tables = {}
+for m in re.finditer(r"#ifdef USE_FONT_(\w+)\s+__UG_FONT_DATA unsigned char (\w+)\[256\]\[(\d+)\]=\{(.*?)\n\};", ugui_c, re.S):
+    name, array, size, body = m.group(1), m.group(2), int(m.group(3)), m.group(4)
+    glyphs = re.findall(r"\{([^{}]*)\}", body)
+    if len(glyphs) != 256:
+        exit("Unexpected glyph count in %s" % array)
+    tables[name] = (array, size, [[int(b, 16) for b in g.split(",")] for g in glyphs])
+
+# Font descriptors
+fonts = {}
+for m in re.finditer(r"const UG_FONT FONT_(\w+) = \{\(unsigned char\*\)(\w+),(FONT_TYPE_\w+),(\d+),(\d+),(\d+),(\d+),NULL\};", ugui_c):
+    fonts.setdefault(m.group(1), (m.group(3), int(m.group(4)), int(m.group(5))))
+
+# Fonts the firmware actually uses
+used = set()
+for src in args.sources:
+    for path in glob.glob(os.path.join(src, "*.[ch]")):
+        with open(path) as f:
+            used.update(re.findall(r"\bFONT_(\d+X\d+\w*)\b", f.read()))
+
+used = sorted(name for name in used if name in fonts and name in tables)
+if not used:
+    exit("No font references found in %s" % ", ".join(args.sources))
+
+def glyph_runs(glyph, width, height):
+    """Lengths of alternating clear/set pixel runs, starting with a clear one"""
+    bn = (width + 7) // 8
+    runs, color, length = [], 0, 0
+    for y in range(height):
+        for x in range(width):
+            if (glyph[y * bn + x // 8] >> (x % 8)) & 1 != color:
+                runs.append(length)
+                color, length = color ^ 1, 0
+            length += 1
+    runs.append(length)
+    return runs
+
+
+def rle_encode(glyph, width, height):
+    """4 bit run lengths, 15 escapes to an 8 bit length. See _UG_DecodeRLE()"""
+    nibbles = []
+    for run in glyph_runs(glyph, width, height):
+        while run > 255:
+            nibbles += [15, 15, 15, 0]  # 255 pixels, then an empty run of the other color
+            run -= 255
+        if run < 15:
+            nibbles.append(run)
+        else:
+            nibbles += [15, run >> 4, run & 15]
+    if len(nibbles) % 2:
+        nibbles.append(0)
+    return [(nibbles[i] << 4) | nibbles[i + 1] for i in range(0, len(nibbles), 2)]
+
+
+def rle_font(glyphs, width, height):
+    """16 bit little endian offset of each glyph, followed by the glyph data"""
+    data = [rle_encode(glyphs[c], width, height) for c in range(first, last + 1)]
+    offset = 2 * len(data)
+    index, blob = [], []
+    for d in data:
+        if offset > 0xFFFF:
+            exit("Compressed font too large for 16 bit offsets")
+        index += [offset & 0xFF, offset >> 8]
+        blob += d
+        offset += len(d)
+    return index + blob
+
+
+def write_bytes(f, data):
+    for i in range(0, len(data), 16):
+        f.write("   %s%s\n" % (",".join("0x%02X" % b for b in data[i:i + 16]), "," if i + 16 < len(data) else ""))
+
+
+header = "/* Generated by tools/packfonts.py, do not edit. */\n"
+
+with open(os.path.join(args.ugui, "ugui_fonts.h"), "w") as f:
+    f.write(header)
+    f.write("#ifndef __UGUI_FONTS_H\n#define __UGUI_FONTS_H\n\n")
+    for name in used:
+        f.write("#define USE_FONT_%s\n" % name)
+    f.write("\n#endif\n")
+
+full_size = 0
+packed_size = 0
+rle_size = 0
+
+with open(os.path.join(args.ugui, "ugui_fonts.c"), "w") as f:
+    f.write(header)
+    f.write("/* Characters 0x%02X-0x%02X only. */\n" % (first, last))
+    f.write('#include "ugui.h"\n\n#ifdef USE_PACKED_FONTS\n')
+
+    for name in used:
+        array, size, glyphs = tables[name]
+        font_type, width, height = fonts[name]
+
+        descriptor = "const UG_FONT FONT_%s = {(unsigned char*)%s,%%s,%d,%d,0x%02X,0x%02X,NULL};\n" \
+                     % (name, array, width, height, first, last)
+
+        if args.rle and height >= args.rle and font_type == "FONT_TYPE_1BPP":
+            data = rle_font(glyphs, width, height)
+            f.write("\n#ifdef USE_RLE_FONTS\n")
+            f.write("__UG_FONT_DATA unsigned char %s[%d]={\n" % (array, len(data)))
+            write_bytes(f, data)
+            f.write("};\n")
+            f.write(descriptor % "FONT_TYPE_1BPP_RLE")
+            f.write("#else")
+            rle_size += len(data)
+        else:
+            rle_size += (last - first + 1) * size
+
+        f.write("\n__UG_FONT_DATA unsigned char %s[%d][%d]={\n" % (array, last - first + 1, size))
+        for c in range(first, last + 1):
+            f.write("{%s}%s   // 0x%02X\n" % (",".join("0x%02X" % b for b in glyphs[c]),
+                                           "," if c < last else " ", c))
+        f.write("};\n")
+        f.write(descriptor % font_type)
+        if args.rle and height >= args.rle and font_type == "FONT_TYPE_1BPP":
+            f.write("#endif\n")
+
+        packed_size += (last - first + 1) * size
+
+    f.write("\n#endif\n")
+
+# Compare against the fonts ugui_config.h enables when not packing
+with open(os.path.join(args.ugui, "ugui_config.h")) as f:
+    enabled = set(re.findall(r"^#define\s+USE_FONT_(\w+)", f.read(), re.M)) & set(tables)
+
+for name in enabled:
+    full_size += 256 * tables[name][1]
+
+print("Fonts kept: %s" % ", ".join("FONT_" + name for name in used))
+print("Glyph data: %d bytes for the %d fonts in ugui_config.h, %d bytes packed (%d bytes saved)"
+      % (full_size, len(enabled), packed_size, full_size - packed_size))
+if rle_size != packed_size:
+    print("With USE_RLE_FONTS: %d bytes" % rle_size)
@@ -0,0 +1,194 @@
+/*
+ * Host check of uGUI: renders random scenes (lines, circles, round frames, 16bpp
+ * bitmaps and text under a clip) from two threads, each into its own context, and
+ * compares both against a single threaded render pixel for pixel. Build and run it
+ * from the project root:
+ *
+ *   gcc -O2 -pthread -Icomponents/ugui tools/ugui_stress.c components/ugui/ugui.c components/ugui/ugui_fonts.c -o ugui_stress && ./ugui_stress
+ *
+ * Add -fsanitize=thread to also catch state shared between contexts. The scenes are
+ * also drawn through pset, with and without a DRAW_LINE driver, which must not change
+ * a pixel. Exits non-zero on any mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "ugui.h"
+
+#define WIDTH (320)
+#define HEIGHT (240)
+#define SCENES (100)
+#define ROUNDS (40)
+#define THREADS (2)
+#define GLYPH_CACHE_SIZE (64 * 1024)
+
+typedef struct
+{
+    int id;
+    int mismatches;
+} worker_t;
+
+static UG_COLOR *reference; // SCENES frames
+static UG_COLOR bitmap[40 * 30];
+static UG_COLOR psetFrame[WIDTH * HEIGHT];
+static UG_GUI lineGui; // What the DRAW_LINE driver draws with
+
+static uint32_t next_random(uint32_t *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 8) & 0x7FFF;
+}
+
+static bool same_frame(const UG_COLOR *fb, int scene)
+{
+    return memcmp(fb, &reference[scene * WIDTH * HEIGHT], WIDTH * HEIGHT * sizeof(UG_COLOR)) == 0;
+}
+
+// Draws scene number seed on g, the same pixels whichever context or thread draws it
+static void draw_scene(UG_GUI *g, int seed)
+{
+    uint32_t r = seed * 2654435761u + 1;
+    const UG_BMP bmp = {bitmap, 40, 30, BMP_BPP_16, BMP_RGB565};
+
+    UG_FillScreenCtx(g, next_random(&r));
+    UG_PushClipCtx(g, next_random(&r) % 100, next_random(&r) % 80,
+                   200 + next_random(&r) % 120, 150 + next_random(&r) % 90);
+
+    for (int i = 0; i < 40; ++i)
+    {
+        int x0 = next_random(&r) % 340 - 10, y0 = next_random(&r) % 260 - 10;
+        int x1 = next_random(&r) % 340 - 10, y1 = next_random(&r) % 260 - 10;
+        int radius = next_random(&r) % 40;
+        UG_COLOR c = next_random(&r);
+
+        switch (i % 8)
+        {
+            case 0: UG_DrawLineCtx(g, x0, y0, x1, y1, c); break;
+            case 1: UG_FillCircleCtx(g, x0, y0, radius, c); break;
+            case 2: UG_FillRoundFrameCtx(g, x0, y0, x1, y1, radius % 10, c); break;
+            case 3: UG_DrawRoundFrameCtx(g, x0, y0, x1, y1, radius % 10, c); break;
+            case 4: UG_DrawBMPCtx(g, x0, y0, (UG_BMP*)&bmp); break;
+            default:
+                UG_FontSelectCtx(g, (next_random(&r) & 1) ? &FONT_8X8 : &FONT_8X12);
+                UG_SetForecolorCtx(g, c);
+                UG_SetBackcolorCtx(g, (next_random(&r) & 3) ? next_random(&r) : c);
+                UG_PutStringCtx(g, x0, y0, "The quick brown fox 0123");
+                UG_PutCharCtx(g, 'A' + next_random(&r) % 26, x1, y1, c, ~c);
+        }
+    }
+
+    UG_PopClipCtx(g);
+}
+
+static void pset_frame(UG_S16 x, UG_S16 y, UG_COLOR c)
+{
+    if (x >= 0 && y >= 0 && x < WIDTH && y < HEIGHT)
+        psetFrame[y * WIDTH + x] = c;
+}
+
+// A DRAW_LINE driver as a display would have one: it draws any line it is given
+static UG_RESULT draw_line(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c)
+{
+    UG_DrawLineCtx(&lineGui, x1, y1, x2, y2, c);
+    return UG_RESULT_OK;
+}
+
+// Scenes drawn with the DRAW_LINE driver that differ from plain pset
+static int check_line_driver()
+{
+    static UG_COLOR expected[WIDTH * HEIGHT];
+    UG_GUI plain, accelerated;
+    int mismatches = 0;
+
+    UG_InitCtx(&lineGui, pset_frame, WIDTH, HEIGHT);
+    UG_InitCtx(&plain, pset_frame, WIDTH, HEIGHT);
+    UG_InitCtx(&accelerated, pset_frame, WIDTH, HEIGHT);
+    UG_DriverRegisterCtx(&accelerated, DRIVER_DRAW_LINE, (void*)draw_line);
+    UG_DriverEnableCtx(&accelerated, DRIVER_DRAW_LINE);
+
+    for (int s = 0; s < SCENES; ++s)
+    {
+        draw_scene(&plain, s);
+        memcpy(expected, psetFrame, sizeof(expected));
+
+        draw_scene(&accelerated, s);
+        if (memcmp(expected, psetFrame, sizeof(expected)) != 0) mismatches++;
+    }
+
+    return mismatches;
+}
+
+static void* worker_task(void *arg)
+{
+    worker_t *worker = arg;
+    UG_COLOR *fb = calloc(WIDTH * HEIGHT, sizeof(UG_COLOR));
+    char *cache = malloc(GLYPH_CACHE_SIZE);
+    UG_GUI g;
+
+    if (!fb || !cache) abort();
+
+    UG_InitFramebufferCtx(&g, fb, WIDTH, HEIGHT, WIDTH);
+    UG_GlyphCacheInitCtx(&g, cache, GLYPH_CACHE_SIZE, 8, 12);
+
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        for (int s = worker->id; s < SCENES; s += THREADS)
+        {
+            draw_scene(&g, s);
+            if (!same_frame(fb, s)) worker->mismatches++;
+        }
+    }
+
+    free(cache);
+    free(fb);
+    return NULL;
+}
+
+int main()
+{
+    static UG_COLOR fb[WIDTH * HEIGHT];
+    static char cache[GLYPH_CACHE_SIZE];
+    pthread_t threads[THREADS];
+    worker_t workers[THREADS];
+    UG_GUI g;
+    int failed = 0;
+
+    reference = malloc(SCENES * WIDTH * HEIGHT * sizeof(UG_COLOR));
+    if (!reference) abort();
+
+    for (int i = 0; i < 40 * 30; ++i)
+        bitmap[i] = i * 37;
+
+    // Single threaded reference, drawn on the selected GUI as the firmware does
+    UG_InitFramebuffer(&g, fb, WIDTH, HEIGHT, WIDTH);
+    UG_GlyphCacheInit(cache, sizeof(cache), 8, 12);
+
+    for (int s = 0; s < SCENES; ++s)
+    {
+        draw_scene(&g, s);
+        memcpy(&reference[s * WIDTH * HEIGHT], fb, sizeof(fb));
+    }
+
+    for (int i = 0; i < THREADS; ++i)
+    {
+        workers[i].id = i;
+        workers[i].mismatches = 0;
+        pthread_create(&threads[i], NULL, worker_task, &workers[i]);
+    }
+
+    for (int i = 0; i < THREADS; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        printf("thread %d: %d scenes x %d rounds, %d mismatches\n",
+               i, SCENES / THREADS, ROUNDS, workers[i].mismatches);
+        failed |= workers[i].mismatches != 0;
+    }
+
+    int lineMismatches = check_line_driver();
+    printf("pset with DRAW_LINE driver: %d scenes, %d mismatches\n", SCENES, lineMismatches);
+    failed |= lineMismatches != 0;
+
+    return failed;
+}